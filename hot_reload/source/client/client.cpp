@@ -14,29 +14,102 @@
 namespace lightctrl {
 
 
-  Client::Client(const std::string& ip, const u16 port) {
+  Client::Client(const std::string& ip, const u16 port, Payload_encoding encoding) {
     m_tcp_socket.open();
     m_tcp_socket.connect(ip, port);
+
+    if (encoding == Payload_encoding::TEXT) return;
+
+    const u8 asked = static_cast<u8>(encoding);
+    Tcp_packet::Header handshake;
+    handshake.signature = static_cast<u8>(Tcp_packet::Packet_signature::HANDSHAKE);
+    send(handshake, &asked, 1);
+
+    Tcp_packet answer;
+    receive(answer);
+    if (answer.get_signature() != Tcp_packet::Packet_signature::HANDSHAKE) {
+      throw std::runtime_error("expected a handshake from the server");
+    }
+    const Buffer<u8> payload = answer.get_payload();
+    m_encoding = decode_encoding(payload.raw(), payload.size());
+    Console::println("Using {} payloads.", get_encoding_as_string(m_encoding));
   }
 
-  void Client::ask() {
+  u32 Client::ask() {
     const int num1 = std::rand() % 10 + 1;
     const int num2 = std::rand() % 10 + 1;
+    const u32 request_id = m_next_request_id++;
 
-    const std::string question = std::to_string(num1) + "," + std::to_string(num2);
-    const Buffer<u8> buffer(question);
-    Tcp_packet packet(Tcp_packet::Packet_signature::REQUEST, buffer);
-    m_tcp_socket.write(packet.get_buffer());
+    u8 payload[MAX_REQUEST_PAYLOAD_SIZE];
+    const u64 size = encode_request(m_encoding, num1, num2, payload);
+    Tcp_packet::Header header;
+    header.signature = static_cast<u8>(Tcp_packet::Packet_signature::REQUEST);
+    header.request_id = request_id;
+    send(header, payload, size);
+    m_pending[request_id] = Question{num1, num2};
 
-    Console::println("Asked: {}", question);
+    Console::println("Asked #{}: {},{}", request_id, num1, num2);
+    return request_id;
   }
 
   void Client::listen() {
-    while (!m_tcp_socket.can_read());
+    Tcp_packet packet;
+    receive(packet);
+    if (packet.get_signature() != Tcp_packet::Packet_signature::RESPONSE) return;
+
+    const auto question = m_pending.find(packet.get_request_id());
+    if (question == m_pending.end()) {
+      Console::println(Logger::level::warn, "Got answer to unknown request #{}.",
+                       packet.get_request_id());
+      return;
+    }
+    const Question asked = question->second;
+    m_pending.erase(question);
+
+    const Buffer<u8> payload = packet.get_payload();
+    if (payload.size() == 0) {
+      Console::println(Logger::level::warn, "Request #{} failed: {},{}.",
+                       packet.get_request_id(), asked.a, asked.b);
+      return;
+    }
+    int result;
+    if (!decode_response(m_encoding, payload.raw(), payload.size(), result)) {
+      Console::println(Logger::level::warn, "Got malformed answer.");
+      return;
+    }
+    Console::println(Logger::level::warn, "Got answer #{}: {},{} = {}.",
+                     packet.get_request_id(), asked.a, asked.b, result);
+  }
+
+  void Client::send(Tcp_packet::Header header, const u8* payload, u64 size) {
+    header.payload_size = static_cast<u32>(size);
+    u8 header_bytes[Tcp_packet::HEADER_SIZE];
+    Tcp_packet::write_header(header, header_bytes);
+
+    chif_net_slice slices[] = {
+      {header_bytes, static_cast<size_t>(Tcp_packet::HEADER_SIZE)},
+      {payload, static_cast<size_t>(size)},
+    };
+    chif_net_slice* slice = slices;
+    u32 count = 2;
+    while (count > 0) {
+      u64 sent = static_cast<u64>(m_tcp_socket.write(slice, count));
+      // step past what was sent, a short write may end inside a slice
+      while (count > 0 && sent >= slice->size) {
+        sent -= slice->size;
+        slice++;
+        count--;
+      }
+      if (count > 0) {
+        slice->data += sent;
+        slice->size -= static_cast<size_t>(sent);
+      }
+    }
+  }
 
-    Tcp_packet packet(Tcp_packet::Packet_signature::INVALID, 1024);
-    m_tcp_socket.read(packet.get_buffer());
-    
-    Console::println(Logger::level::warn, "Got answer {}.", packet.get_payload_as_string());
+  void Client::receive(Tcp_packet& packet) {
+    while (!m_decoder.next(packet)) {
+      m_decoder.receive(m_tcp_socket);
+    }
   }
 }
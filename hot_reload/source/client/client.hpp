@@ -6,7 +6,10 @@
 
 #include "../net/tcp_socket.hpp"
 #include "../net/tcp_packet.hpp"
+#include "../net/packet_decoder.hpp"
+#include "../net/payload.hpp"
 #include "../core/buffer.hpp"
+#include <unordered_map>
 
 // ============================================================ //
 // Class Declaration
@@ -18,16 +21,53 @@ namespace lightctrl {
 
   public:
 
-    Client(const std::string& ip, const u16 port);
+    /**
+     * Connect, and agree with the server on the payload encoding.
+     * @param encoding Asked for, the server may answer with another one.
+     */
+    Client(const std::string& ip, const u16 port,
+           Payload_encoding encoding = Payload_encoding::BINARY);
 
-    void ask();
+    /**
+     * Send a request without waiting for the answer. Any number of requests
+     * may be in flight, the answers come back in whatever order the server
+     * completes them.
+     * @return Id of the request, repeated in its answer.
+     */
+    u32 ask();
 
+    /** Wait for the next answer, to whichever request it belongs **/
     void listen();
 
+    /** Requests asked but not answered yet **/
+    u64 pending() const { return m_pending.size(); }
+
+  private:
+
+    /** Block until header and payload are sent, in one write if the socket takes it **/
+    void send(Tcp_packet::Header header, const u8* payload, u64 size);
+
+    /** Block until a whole packet is received **/
+    void receive(Tcp_packet& packet);
+
   private:
 
     Tcp_socket m_tcp_socket;
 
+    Packet_decoder m_decoder;
+
+    Payload_encoding m_encoding = Payload_encoding::TEXT;
+
+    /** Operands of a request, kept until it is answered **/
+    struct Question {
+      int a;
+      int b;
+    };
+
+    std::unordered_map<u32, Question> m_pending;
+
+    u32 m_next_request_id = 0;
+
   };
 
 }
@@ -0,0 +1,80 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "allocation_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// ============================================================ //
+// Counting Allocation Functions
+// ============================================================ //
+
+namespace {
+
+  thread_local u64 g_thread_allocations = 0;
+
+  std::atomic<u64> g_total_allocations{0};
+
+}
+
+#if defined(LIGHTCTRL_COUNT_ALLOCATIONS)
+
+namespace {
+
+  void* counted_allocate(std::size_t size) {
+    g_thread_allocations++;
+    g_total_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+  }
+
+}
+
+void* operator new(std::size_t size) {
+  void* memory = counted_allocate(size);
+  if (memory == nullptr) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new[](std::size_t size) {
+  void* memory = counted_allocate(size);
+  if (memory == nullptr) throw std::bad_alloc();
+  return memory;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_allocate(size);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete[](void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+
+#endif
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+u64 Allocation_counter::thread_count() {
+  return g_thread_allocations;
+}
+
+// ============================================================ //
+
+u64 Allocation_counter::total_count() {
+  return g_total_allocations.load(std::memory_order_relaxed);
+}
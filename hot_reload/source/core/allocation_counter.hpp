@@ -0,0 +1,45 @@
+#ifndef LIGHTCTRL_BACKEND_ALLOCATION_COUNTER_HPP
+#define LIGHTCTRL_BACKEND_ALLOCATION_COUNTER_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+
+// ====================================================================== //
+// Class Declaration
+// ====================================================================== //
+
+/**
+ * Counts heap allocations, so a test or a debug build can check that a code
+ * path does not allocate.
+ *
+ * Counting replaces the global operator new and delete, it is only compiled
+ * in when LIGHTCTRL_COUNT_ALLOCATIONS is defined. Otherwise ENABLED is false
+ * and the counts stay 0. Over-aligned allocations are not counted.
+ *
+ *  Usage:
+ *   const u64 before = Allocation_counter::thread_count();
+ *   ...
+ *   assert(Allocation_counter::thread_count() == before);
+ */
+class Allocation_counter {
+
+public:
+
+#if defined(LIGHTCTRL_COUNT_ALLOCATIONS)
+  static constexpr bool ENABLED = true;
+#else
+  static constexpr bool ENABLED = false;
+#endif
+
+  /** Allocations made by the calling thread since it started **/
+  static u64 thread_count();
+
+  /** Allocations made by every thread since start **/
+  static u64 total_count();
+
+};
+
+#endif //LIGHTCTRL_BACKEND_ALLOCATION_COUNTER_HPP
@@ -0,0 +1,225 @@
+#ifndef LIGHTCTRL_BACKEND_BOUNDED_QUEUE_HPP
+#define LIGHTCTRL_BACKEND_BOUNDED_QUEUE_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// ====================================================================== //
+// Class Declaration
+// ====================================================================== //
+
+/**
+ * Multi producer, multi consumer queue with a fixed capacity.
+ * Producers block while the queue is full, consumers while it is empty.
+ *
+ * Items are kept in a ring allocated once, at construction, pushing and
+ * popping never allocates.
+ */
+template <typename T>
+class Bounded_queue {
+
+  // ====================================================================== //
+  // Variables and Constants
+  // ====================================================================== //
+
+private:
+
+  /** Ring of m_capacity slots **/
+  std::vector<T> m_queue;
+
+  u64 m_capacity;
+
+  /** Slot of the oldest item **/
+  u64 m_front = 0;
+
+  u64 m_size = 0;
+
+  /** Once closed, push fails and pop only drains what is left **/
+  bool m_closed = false;
+
+  std::mutex m_mutex;
+
+  std::condition_variable m_not_full;
+
+  std::condition_variable m_not_empty;
+
+  // ====================================================================== //
+  // Lifetime methods
+  // ====================================================================== //
+
+public:
+
+  explicit Bounded_queue(u64 capacity)
+    : m_queue(capacity > 0 ? capacity : 1), m_capacity(capacity > 0 ? capacity : 1) {}
+
+  Bounded_queue(const Bounded_queue& other) = delete;
+
+  Bounded_queue& operator=(const Bounded_queue& other) = delete;
+
+  // ====================================================================== //
+  // Misc methods
+  // ====================================================================== //
+
+public:
+
+  /**
+   * Block until there is room, then add item.
+   * @return False if the queue has been closed, item is then left untouched.
+   */
+  bool push(T&& item);
+
+  /**
+   * Move all items in, blocking whenever the queue is full.
+   * @return Number of items pushed, less than count only if the queue was closed.
+   */
+  template <typename Input_iterator>
+  u64 push_many(Input_iterator begin, u64 count);
+
+  /**
+   * Move in as many items as there is room for, without blocking.
+   * @return Number of items pushed, 0 if the queue is full or closed.
+   */
+  template <typename Input_iterator>
+  u64 try_push_many(Input_iterator begin, u64 count);
+
+  /**
+   * Block until there is an item and move it out.
+   * @return False if the queue is closed and empty.
+   */
+  bool pop(T& item);
+
+  /**
+   * Block until there is at least one item, then move up to max_items out.
+   * @return Number of items popped, 0 if the queue is closed and empty.
+   */
+  template <typename Output_iterator>
+  u64 pop_many(Output_iterator out, u64 max_items);
+
+  /** Wake everyone up, further pushes fails. **/
+  void close();
+
+private:
+
+  /** Add at the back, the lock is held and there is room **/
+  void push_back(T&& item);
+
+
+};
+
+// ====================================================================== //
+// Class Template Implementation
+// ====================================================================== //
+
+template <typename T>
+bool Bounded_queue<T>::push(T&& item) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_not_full.wait(lock, [this] { return m_closed || m_size < m_capacity; });
+  if (m_closed) return false;
+
+  push_back(std::move(item));
+  lock.unlock();
+  m_not_empty.notify_one();
+  return true;
+}
+
+// ============================================================ //
+
+template <typename T>
+template <typename Input_iterator>
+u64 Bounded_queue<T>::push_many(Input_iterator begin, u64 count) {
+  u64 pushed = 0;
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (pushed < count) {
+    m_not_full.wait(lock, [this] { return m_closed || m_size < m_capacity; });
+    if (m_closed) break;
+
+    while (pushed < count && m_size < m_capacity) {
+      push_back(std::move(*begin));
+      ++begin;
+      pushed++;
+    }
+    m_not_empty.notify_all();
+  }
+
+  return pushed;
+}
+
+// ============================================================ //
+
+template <typename T>
+template <typename Input_iterator>
+u64 Bounded_queue<T>::try_push_many(Input_iterator begin, u64 count) {
+  u64 pushed = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_closed) return 0;
+
+    while (pushed < count && m_size < m_capacity) {
+      push_back(std::move(*begin));
+      ++begin;
+      pushed++;
+    }
+  }
+
+  if (pushed > 0) m_not_empty.notify_all();
+  return pushed;
+}
+
+// ============================================================ //
+
+template <typename T>
+bool Bounded_queue<T>::pop(T& item) {
+  return pop_many(&item, 1) == 1;
+}
+
+// ============================================================ //
+
+template <typename T>
+template <typename Output_iterator>
+u64 Bounded_queue<T>::pop_many(Output_iterator out, u64 max_items) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_not_empty.wait(lock, [this] { return m_closed || m_size > 0; });
+
+  u64 popped = 0;
+  while (popped < max_items && m_size > 0) {
+    *out = std::move(m_queue[m_front]);
+    ++out;
+    m_front = m_front + 1 == m_capacity ? 0 : m_front + 1;
+    m_size--;
+    popped++;
+  }
+
+  lock.unlock();
+  m_not_full.notify_all();
+  return popped;
+}
+
+// ============================================================ //
+
+template <typename T>
+void Bounded_queue<T>::close() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+  }
+  m_not_full.notify_all();
+  m_not_empty.notify_all();
+}
+
+// ============================================================ //
+
+template <typename T>
+void Bounded_queue<T>::push_back(T&& item) {
+  const u64 back = m_front + m_size;
+  m_queue[back < m_capacity ? back : back - m_capacity] = std::move(item);
+  m_size++;
+}
+
+#endif //LIGHTCTRL_BACKEND_BOUNDED_QUEUE_HPP
@@ -28,6 +28,9 @@ public:
   static constexpr flag FLAG_NO_FLAGS = 0;
   static constexpr flag FLAG_CLEAR = 1;
 
+  /** Gives an owned buffer back to where it came from, instead of delete[] **/
+  using release_function = void (*)(Buffer_type* buffer, u64 capacity);
+
 private:
 
   /** The underlying buffer **/
@@ -42,6 +45,9 @@ private:
   /** If we should delete m_buffer on destruction, used by sub buffers **/
   bool m_own_buffer = true;
 
+  /** Called instead of delete[] for an owned buffer, if set **/
+  release_function m_release = nullptr;
+
   // ====================================================================== //
   // Lifetime methods
   // ====================================================================== //
@@ -67,6 +73,16 @@ public:
   /** Construct empty buffer **/
   Buffer();
 
+  /**
+   * Construct an empty buffer from memory that is given back with release
+   * instead of delete[], such as a block from Buffer_pool.
+   * @param buffer Takes ownership of this buffer.
+   * @param capacity Size of buffer
+   * @param release Called with buffer and capacity when the buffer is
+   *                destroyed or replaced.
+   */
+  static Buffer with_release(Buffer_type* buffer, u64 capacity, release_function release);
+
   /** Copy constructor **/
   Buffer(const Buffer& other);
 
@@ -86,7 +102,12 @@ public:
    * Create a sub buffer. Will not delete buffer on destruction.
    * Destructing parent before you are done with sub buffer may cause SEGFAULT.
    **/
-  Buffer&& make_sub_buffer(u64 offset);
+  Buffer make_sub_buffer(u64 offset);
+
+private:
+
+  /** Delete or release m_buffer if we own it **/
+  void free_buffer();
 
 
 // ====================================================================== //
@@ -133,6 +154,9 @@ public:
   /** Return size of buffer **/
   u64 capacity() const { return m_capacity; };
 
+  /** False for sub buffers and views, they can not grow **/
+  bool owns_buffer() const { return m_own_buffer; };
+
   /**
    * Delete current buffer and make new one with a copy of data
    * @pre Size of data must be size - offset.
@@ -195,6 +219,16 @@ Buffer<Buffer_type>::Buffer() : m_buffer(nullptr), m_capacity(0), m_size(0) {}
 
 // ============================================================ //
 
+template <typename Buffer_type>
+Buffer<Buffer_type> Buffer<Buffer_type>::with_release(Buffer_type* buffer, u64 capacity,
+                                                      release_function release) {
+  Buffer result(buffer, capacity, 0);
+  result.m_release = release;
+  return result;
+}
+
+// ============================================================ //
+
 template <typename Buffer_type>
 Buffer<Buffer_type>::Buffer(const Buffer<Buffer_type> &other) {
   m_buffer = new Buffer_type[other.m_capacity];
@@ -211,18 +245,18 @@ Buffer<Buffer_type>::Buffer(Buffer<Buffer_type> &&other) noexcept {
   m_capacity = other.m_capacity;
   m_size = other.m_size;
   m_own_buffer = other.m_own_buffer;
+  m_release = other.m_release;
   other.m_buffer = nullptr;
   other.m_capacity = 0;
   other.m_size = 0;
+  other.m_release = nullptr;
 }
 
 // ============================================================ //
 
 template <typename Buffer_type>
 Buffer<Buffer_type>::~Buffer() {
-  if (m_own_buffer) {
-    delete[] m_buffer;
-  }
+  free_buffer();
 }
 
 // ============================================================ //
@@ -231,10 +265,11 @@ template <typename Buffer_type>
 Buffer<Buffer_type> &Buffer<Buffer_type>::operator=(const Buffer<Buffer_type> &other) {
   if (this == &other) return *this;
 
-  if (m_capacity != other.m_capacity) {
-    delete[] m_buffer;
+  if (m_capacity != other.m_capacity || !m_own_buffer) {
+    free_buffer();
     m_buffer = new Buffer_type[other.m_capacity];
     m_capacity = other.m_capacity;
+    m_own_buffer = true;
   }
 
   m_size = other.m_size;
@@ -247,24 +282,40 @@ Buffer<Buffer_type> &Buffer<Buffer_type>::operator=(const Buffer<Buffer_type> &o
 
 template <typename Buffer_type>
 Buffer<Buffer_type> &Buffer<Buffer_type>::operator=(Buffer<Buffer_type> &&other) noexcept {
-  delete[] m_buffer;
+  if (this == &other) return *this;
+  free_buffer();
   m_buffer = other.m_buffer;
   m_capacity = other.m_capacity;
   m_size = other.m_size;
   m_own_buffer = other.m_own_buffer;
+  m_release = other.m_release;
   other.m_buffer = nullptr;
   other.m_capacity = 0;
   other.m_size = 0;
+  other.m_release = nullptr;
   return *this;
 }
 
 // ============================================================ //
 
 template <typename Buffer_type>
-Buffer<Buffer_type>&& Buffer<Buffer_type>::make_sub_buffer(u64 offset) {
-  Buffer sub_buffer = Buffer(m_buffer + offset, m_capacity - offset,
-                             m_size < offset ? 0 : m_size - offset, false);
-  return std::move(sub_buffer);
+Buffer<Buffer_type> Buffer<Buffer_type>::make_sub_buffer(u64 offset) {
+  return Buffer(m_buffer + offset, m_capacity - offset,
+                m_size < offset ? 0 : m_size - offset, false);
+}
+
+// ============================================================ //
+
+template <typename Buffer_type>
+void Buffer<Buffer_type>::free_buffer() {
+  if (!m_own_buffer) return;
+  if (m_release) {
+    m_release(m_buffer, m_capacity);
+    m_release = nullptr;
+  }
+  else {
+    delete[] m_buffer;
+  }
 }
 
 
@@ -312,7 +363,7 @@ void Buffer<Buffer_type>::resize(u64 capacity, bool copy_old) {
   if (m_buffer && copy_old) {
     memcpy(new_buffer, m_buffer, static_cast<size_t>(std::min(capacity, m_size)));
   }
-  delete[] m_buffer;
+  free_buffer();
 
   m_buffer = new_buffer;
   m_capacity = capacity;
@@ -326,19 +377,21 @@ void Buffer<Buffer_type>::resize(u64 capacity, bool copy_old) {
 
 template <typename Buffer_type>
 void Buffer<Buffer_type>::copy_set(const Buffer_type *data, u64 capacity, u64 size, u64 offset) {
-  delete[] m_buffer;
+  free_buffer();
   m_buffer = new Buffer_type[static_cast<unsigned int>(capacity)];
+  m_own_buffer = true;
   m_capacity = capacity;
   m_size = size;
-  memcpy(&m_buffer[offset], data, static_cast<size_t>(m_size));
+  memcpy(&m_buffer[offset], data, static_cast<size_t>(m_size - offset));
 }
 
 // ============================================================ //
 
 template <typename Buffer_type>
 void Buffer<Buffer_type>::move_set(Buffer_type* data, u64 capacity, u64 size) {
-  delete[] m_buffer;
+  free_buffer();
   m_buffer = data;
+  m_own_buffer = true;
   m_capacity = capacity;
   m_size = size;
 }
@@ -354,10 +407,11 @@ std::string Buffer<Buffer_type>::as_string() const {
 
 template <typename Buffer_type>
 void Buffer<Buffer_type>::from_string(const std::string& string) {
-  if (m_capacity < string.size()) {
-    delete[] m_buffer;
+  if (m_capacity < string.size() || !m_own_buffer) {
+    free_buffer();
     m_capacity = string.size();
     m_buffer = new Buffer_type[m_capacity];
+    m_own_buffer = true;
   }
 
   m_size = string.size();
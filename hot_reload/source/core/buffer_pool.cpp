@@ -0,0 +1,82 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "buffer_pool.hpp"
+
+// ============================================================ //
+// Freelist
+// ============================================================ //
+
+namespace {
+
+  /** Overlays the first bytes of a free block **/
+  struct Free_block {
+    Free_block* next;
+  };
+
+  struct Freelist {
+    Free_block* head = nullptr;
+    u64 count = 0;
+
+    /** The blocks go back to the heap when the thread exits **/
+    ~Freelist() {
+      while (head != nullptr) {
+        Free_block* block = head;
+        head = block->next;
+        delete[] reinterpret_cast<u8*>(block);
+      }
+      count = 0;
+    }
+  };
+
+  thread_local Freelist g_freelist;
+
+}
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+Buffer<u8> Buffer_pool::make_buffer(u64 capacity) {
+  if (capacity > BLOCK_SIZE) return Buffer<u8>(capacity);
+  return Buffer<u8>::with_release(acquire(), BLOCK_SIZE, &Buffer_pool::release);
+}
+
+// ============================================================ //
+
+u8* Buffer_pool::acquire() {
+  Freelist& freelist = g_freelist;
+  if (freelist.head == nullptr) {
+    static_assert(BLOCK_SIZE >= sizeof(Free_block), "block can not hold the freelist link");
+    return new u8[BLOCK_SIZE];
+  }
+
+  Free_block* block = freelist.head;
+  freelist.head = block->next;
+  freelist.count--;
+  return reinterpret_cast<u8*>(block);
+}
+
+// ============================================================ //
+
+void Buffer_pool::release(u8* block, u64 capacity) {
+  if (block == nullptr) return;
+
+  Freelist& freelist = g_freelist;
+  if (capacity != BLOCK_SIZE || freelist.count >= MAX_FREE_BLOCKS) {
+    delete[] block;
+    return;
+  }
+
+  Free_block* free_block = reinterpret_cast<Free_block*>(block);
+  free_block->next = freelist.head;
+  freelist.head = free_block;
+  freelist.count++;
+}
+
+// ============================================================ //
+
+u64 Buffer_pool::free_blocks() {
+  return g_freelist.count;
+}
@@ -0,0 +1,60 @@
+#ifndef LIGHTCTRL_BACKEND_BUFFER_POOL_HPP
+#define LIGHTCTRL_BACKEND_BUFFER_POOL_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+#include "../core/buffer.hpp"
+
+// ====================================================================== //
+// Class Declaration
+// ====================================================================== //
+
+/**
+ * Freelist of fixed size byte blocks, one per thread.
+ *
+ * Packets and the buffers of a connection are taken from here instead of
+ * the heap. A Buffer made by make_buffer gives its block back when it is
+ * destroyed or resized, so a block is only allocated once and then handed
+ * from connection to connection and packet to packet.
+ *
+ * A block may be given back on another thread than it was taken on, it then
+ * joins that thread's freelist. Free blocks are linked through their first
+ * bytes, the pool allocates nothing but the blocks.
+ */
+class Buffer_pool {
+
+public:
+
+  /** Size of every block, a connection's buffers and most packets fit **/
+  static constexpr u64 BLOCK_SIZE = 4096;
+
+  /** Free blocks kept per thread, more are given back to the heap **/
+  static constexpr u64 MAX_FREE_BLOCKS = 256;
+
+public:
+
+  /**
+   * Empty buffer that can hold at least capacity bytes. It uses a block
+   * from the calling thread's pool if capacity fits in one, and the heap
+   * otherwise.
+   */
+  static Buffer<u8> make_buffer(u64 capacity = BLOCK_SIZE);
+
+  /** A block, from the calling thread's freelist if it has one **/
+  static u8* acquire();
+
+  /**
+   * Give back a block taken with acquire. Used as the release function of
+   * pooled Buffers.
+   */
+  static void release(u8* block, u64 capacity);
+
+  /** Free blocks on the calling thread **/
+  static u64 free_blocks();
+
+};
+
+#endif //LIGHTCTRL_BACKEND_BUFFER_POOL_HPP
@@ -0,0 +1,45 @@
+#ifndef LIGHTCTRL_BACKEND_BYTE_ORDER_HPP
+#define LIGHTCTRL_BACKEND_BYTE_ORDER_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+#include <type_traits>
+
+// ====================================================================== //
+// Functions
+// ====================================================================== //
+
+/**
+ * Store an integer least significant byte first, whatever the byte order of
+ * the host. data needs no alignment. Compiles to a plain store on little
+ * endian hosts.
+ */
+template <typename Integer>
+inline void store_le(u8* data, Integer value) {
+  static_assert(std::is_integral<Integer>::value, "store_le takes integers");
+  using Unsigned = typename std::make_unsigned<Integer>::type;
+  Unsigned bits = static_cast<Unsigned>(value);
+  for (u64 i = 0; i < sizeof(Integer); i++) {
+    data[i] = static_cast<u8>(bits & 0xFF);
+    bits = static_cast<Unsigned>(bits >> 8);
+  }
+}
+
+// ============================================================ //
+
+/** Load an integer stored by store_le **/
+template <typename Integer>
+inline Integer load_le(const u8* data) {
+  static_assert(std::is_integral<Integer>::value, "load_le takes integers");
+  using Unsigned = typename std::make_unsigned<Integer>::type;
+  Unsigned bits = 0;
+  for (u64 i = sizeof(Integer); i-- > 0;) {
+    bits = static_cast<Unsigned>(bits << 8 | data[i]);
+  }
+  return static_cast<Integer>(bits);
+}
+
+#endif //LIGHTCTRL_BACKEND_BYTE_ORDER_HPP
@@ -0,0 +1,200 @@
+#ifndef LIGHTCTRL_BACKEND_SLAB_HPP
+#define LIGHTCTRL_BACKEND_SLAB_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// ====================================================================== //
+// Class Declaration
+// ====================================================================== //
+
+/**
+ * Table of objects addressed by generational handles.
+ *
+ * Objects live in fixed size pages that are never moved, so a reference
+ * stays valid until its own object is erased. Erased slots are reused, the
+ * generation in the handle then tells a stale handle from the new owner of
+ * the slot. Insert, erase and lookup are O(1).
+ */
+template <typename T>
+class Slab {
+
+  // ====================================================================== //
+  // Data Types Declaration
+  // ====================================================================== //
+
+public:
+
+  /** Generation in the high 32 bits, slot index in the low 32 bits **/
+  using handle = u64;
+
+  /** Never returned by emplace **/
+  static constexpr handle INVALID_HANDLE = ~0ULL;
+
+private:
+
+  struct Slot {
+    alignas(T) unsigned char storage[sizeof(T)];
+    /** Odd while the slot holds an object **/
+    u32 generation = 0;
+    /** Next free slot, while this one is free **/
+    u32 next_free = NO_SLOT;
+
+    T* get() { return reinterpret_cast<T*>(storage); }
+    bool live() const { return (generation & 1) != 0; }
+  };
+
+  // ====================================================================== //
+  // Variables and Constants
+  // ====================================================================== //
+
+private:
+
+  static constexpr u32 NO_SLOT = ~0U;
+
+  static constexpr u32 PAGE_SIZE = 64;
+
+  std::vector<std::unique_ptr<Slot[]>> m_pages;
+
+  /** Slots in use or on the free list **/
+  u32 m_slots = 0;
+
+  u32 m_free = NO_SLOT;
+
+  u64 m_size = 0;
+
+  // ====================================================================== //
+  // Lifetime methods
+  // ====================================================================== //
+
+public:
+
+  Slab() = default;
+
+  ~Slab();
+
+  Slab(const Slab& other) = delete;
+
+  Slab& operator=(const Slab& other) = delete;
+
+  // ====================================================================== //
+  // Misc methods
+  // ====================================================================== //
+
+public:
+
+  /**
+   * Construct an object in a free slot.
+   * @return Handle to the new object.
+   */
+  template <typename... Args>
+  handle emplace(Args&&... args);
+
+  /**
+   * Destroy the object, the slot is then reused by later inserts.
+   * Stale handles are ignored.
+   */
+  void erase(handle h);
+
+  /** @return The object, or nullptr if the handle is stale **/
+  T* get(handle h);
+
+  /**
+   * Call fn(handle, T&) for every object, in slot order. fn may not insert
+   * or erase.
+   */
+  template <typename Function>
+  void for_each(Function fn);
+
+  u64 size() const { return m_size; }
+
+  bool empty() const { return m_size == 0; }
+
+private:
+
+  Slot& slot(u32 index) { return m_pages[index / PAGE_SIZE][index % PAGE_SIZE]; }
+
+  static handle make_handle(u32 index, u32 generation) {
+    return (static_cast<u64>(generation) << 32) | index;
+  }
+
+};
+
+// ====================================================================== //
+// Class Template Implementation
+// ====================================================================== //
+
+template <typename T>
+Slab<T>::~Slab() {
+  for (u32 i = 0; i < m_slots; i++) {
+    if (slot(i).live()) slot(i).get()->~T();
+  }
+}
+
+// ============================================================ //
+
+template <typename T>
+template <typename... Args>
+typename Slab<T>::handle Slab<T>::emplace(Args&&... args) {
+  u32 index = m_free;
+  if (index == NO_SLOT) {
+    if (m_slots == m_pages.size() * PAGE_SIZE) {
+      m_pages.emplace_back(new Slot[PAGE_SIZE]);
+    }
+    index = m_slots++;
+  }
+
+  Slot& s = slot(index);
+  new (s.storage) T(std::forward<Args>(args)...);
+  if (index == m_free) m_free = s.next_free;
+  s.generation++;
+  m_size++;
+  return make_handle(index, s.generation);
+}
+
+// ============================================================ //
+
+template <typename T>
+void Slab<T>::erase(handle h) {
+  if (get(h) == nullptr) return;
+
+  const u32 index = static_cast<u32>(h);
+  Slot& s = slot(index);
+  s.get()->~T();
+  s.generation++;
+  s.next_free = m_free;
+  m_free = index;
+  m_size--;
+}
+
+// ============================================================ //
+
+template <typename T>
+T* Slab<T>::get(handle h) {
+  const u32 index = static_cast<u32>(h);
+  if (index >= m_slots) return nullptr;
+
+  Slot& s = slot(index);
+  if (s.generation != static_cast<u32>(h >> 32) || !s.live()) return nullptr;
+  return s.get();
+}
+
+// ============================================================ //
+
+template <typename T>
+template <typename Function>
+void Slab<T>::for_each(Function fn) {
+  for (u32 i = 0; i < m_slots; i++) {
+    Slot& s = slot(i);
+    if (s.live()) fn(make_handle(i, s.generation), *s.get());
+  }
+}
+
+#endif //LIGHTCTRL_BACKEND_SLAB_HPP
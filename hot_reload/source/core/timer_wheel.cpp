@@ -0,0 +1,129 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "timer_wheel.hpp"
+#include <chrono>
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+Timer_wheel::Timer::~Timer() {
+  if (armed()) m_wheel->cancel(*this);
+}
+
+// ============================================================ //
+
+Timer_wheel::Timer_wheel(u64 tick_ms, u64 now_ms)
+  : m_tick_ms(tick_ms), m_current(now_ms / tick_ms) {}
+
+// ============================================================ //
+
+Timer_wheel::~Timer_wheel() {
+  // leave the timers that outlive us disarmed
+  for (auto& level : m_slots) {
+    for (auto& slot : level) {
+      while (slot != nullptr) unlink(*slot);
+    }
+  }
+}
+
+// ============================================================ //
+
+void Timer_wheel::arm(Timer& timer, u64 key, u64 now_ms, u64 delay_ms) {
+  cancel(timer);
+  timer.m_wheel = this;
+  timer.m_key = key;
+  timer.m_expires = (now_ms + delay_ms + m_tick_ms - 1) / m_tick_ms;
+  insert(timer);
+  m_armed++;
+}
+
+// ============================================================ //
+
+void Timer_wheel::cancel(Timer& timer) {
+  if (!timer.armed()) return;
+
+  unlink(timer);
+  m_armed--;
+}
+
+// ============================================================ //
+
+s32 Timer_wheel::next_timeout_ms(u64 now_ms) const {
+  if (m_armed == 0) return NO_TIMEOUT;
+
+  // stop at the first non empty slot, or where the next cascade happens
+  u64 tick = m_current;
+  while ((tick & SLOT_MASK) != 0 && m_slots[0][tick & SLOT_MASK] == nullptr) {
+    tick++;
+  }
+
+  const u64 at_ms = tick * m_tick_ms;
+  return at_ms > now_ms ? static_cast<s32>(at_ms - now_ms) : 0;
+}
+
+// ============================================================ //
+
+u64 Timer_wheel::now_ms() {
+  using namespace std::chrono;
+  return static_cast<u64>(
+    duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+// ============================================================ //
+
+void Timer_wheel::insert(Timer& timer) {
+  u64 expires = timer.m_expires < m_current ? m_current : timer.m_expires;
+  u64 delta = expires - m_current;
+  if (delta > MAX_DELTA) {
+    delta = MAX_DELTA;
+    expires = m_current + MAX_DELTA;
+  }
+
+  u32 level = 0;
+  while (level < LEVELS - 1 && delta >> ((level + 1) * SLOT_BITS) != 0) {
+    level++;
+  }
+
+  Timer*& slot = m_slots[level][(expires >> (level * SLOT_BITS)) & SLOT_MASK];
+  timer.m_next = slot;
+  if (slot != nullptr) slot->m_pprev = &timer.m_next;
+  timer.m_pprev = &slot;
+  slot = &timer;
+}
+
+// ============================================================ //
+
+void Timer_wheel::unlink(Timer& timer) {
+  *timer.m_pprev = timer.m_next;
+  if (timer.m_next != nullptr) timer.m_next->m_pprev = timer.m_pprev;
+  timer.m_next = nullptr;
+  timer.m_pprev = nullptr;
+}
+
+// ============================================================ //
+
+u64 Timer_wheel::cascade(u32 level) {
+  const u64 index = (m_current >> (level * SLOT_BITS)) & SLOT_MASK;
+
+  Timer* timer = m_slots[level][index];
+  m_slots[level][index] = nullptr;
+  while (timer != nullptr) {
+    Timer* next = timer->m_next;
+    insert(*timer);
+    timer = next;
+  }
+
+  return index;
+}
+
+// ============================================================ //
+
+void Timer_wheel::cascade_due() {
+  for (u32 level = 1; level < LEVELS; level++) {
+    if (((m_current >> ((level - 1) * SLOT_BITS)) & SLOT_MASK) != 0) break;
+    if (cascade(level) != 0) break;
+  }
+}
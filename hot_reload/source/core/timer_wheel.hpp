@@ -0,0 +1,193 @@
+#ifndef LIGHTCTRL_BACKEND_TIMER_WHEEL_HPP
+#define LIGHTCTRL_BACKEND_TIMER_WHEEL_HPP
+
+// ====================================================================== //
+// Headers
+// ====================================================================== //
+
+#include "../core/types.hpp"
+
+// ====================================================================== //
+// Class Declaration
+// ====================================================================== //
+
+/**
+ * Hierarchical timing wheel, driven by the owner's event loop.
+ *
+ * Timers are intrusive, the owner embeds a Timer next to the state it
+ * guards and arms it with a delay. Arming, re-arming and cancelling are
+ * O(1), and advance only touches the timers that are due, or are moved
+ * down a level, so a large number of idle timers costs nothing per run.
+ *
+ * The wheel has LEVELS levels of SLOTS slots, level 0 has a slot per tick.
+ * Timers further away than the top level can hold are parked in it and
+ * moved down again until they are due.
+ */
+class Timer_wheel {
+
+  // ====================================================================== //
+  // Data Types Declaration
+  // ====================================================================== //
+
+public:
+
+  /**
+   * Embed in the object the timer belongs to. Cancelled on destruction, and
+   * can not be copied or moved while it may be armed.
+   */
+  class Timer {
+    friend class Timer_wheel;
+
+  public:
+
+    Timer() = default;
+
+    ~Timer();
+
+    Timer(const Timer& other) = delete;
+
+    Timer& operator=(const Timer& other) = delete;
+
+    bool armed() const { return m_pprev != nullptr; }
+
+    /** Given to arm, tells the owner which timer expired **/
+    u64 key() const { return m_key; }
+
+    /** Tick at which the timer is due **/
+    u64 deadline() const { return m_expires; }
+
+  private:
+
+    Timer_wheel* m_wheel = nullptr;
+    Timer* m_next = nullptr;
+    /** The pointer pointing at us, nullptr when not armed **/
+    Timer** m_pprev = nullptr;
+    u64 m_key = 0;
+    u64 m_expires = 0;
+  };
+
+  /** Used as timeout to the poller when no timer is armed **/
+  static constexpr s32 NO_TIMEOUT = -1;
+
+  // ====================================================================== //
+  // Variables and Constants
+  // ====================================================================== //
+
+private:
+
+  static constexpr u32 LEVELS = 4;
+  static constexpr u32 SLOT_BITS = 6;
+  static constexpr u32 SLOTS = 1 << SLOT_BITS;
+  static constexpr u64 SLOT_MASK = SLOTS - 1;
+  /** Furthest a timer can be placed from the current tick **/
+  static constexpr u64 MAX_DELTA = (1ULL << (LEVELS * SLOT_BITS)) - 1;
+
+  Timer* m_slots[LEVELS][SLOTS]{};
+
+  u64 m_tick_ms;
+
+  /** Next tick to run, earlier ticks have run **/
+  u64 m_current;
+
+  u64 m_armed = 0;
+
+  // ====================================================================== //
+  // Lifetime methods
+  // ====================================================================== //
+
+public:
+
+  /**
+   * @param tick_ms Resolution of the timers.
+   * @param now_ms Current time, see now_ms().
+   */
+  Timer_wheel(u64 tick_ms, u64 now_ms);
+
+  ~Timer_wheel();
+
+  Timer_wheel(const Timer_wheel& other) = delete;
+
+  Timer_wheel& operator=(const Timer_wheel& other) = delete;
+
+  // ====================================================================== //
+  // Misc methods
+  // ====================================================================== //
+
+public:
+
+  /**
+   * Arm the timer to be due in delay_ms, an armed timer is moved.
+   * Rounded up to whole ticks.
+   * @param key Whatever the owner needs to find the timer's object.
+   */
+  void arm(Timer& timer, u64 key, u64 now_ms, u64 delay_ms);
+
+  /** Disarm the timer, does nothing if it is not armed **/
+  void cancel(Timer& timer);
+
+  /**
+   * Run the ticks up to now_ms and call on_expired(Timer&) for every timer
+   * that is due, after disarming it. on_expired may arm and cancel timers.
+   */
+  template <typename Function>
+  void advance(u64 now_ms, Function on_expired);
+
+  /**
+   * @return Milliseconds until advance has something to do, at most the
+   *         time until the next level change. NO_TIMEOUT if nothing is armed.
+   */
+  s32 next_timeout_ms(u64 now_ms) const;
+
+  u64 armed() const { return m_armed; }
+
+  /** Milliseconds on a monotonic clock **/
+  static u64 now_ms();
+
+private:
+
+  /** Put the timer in the slot matching its deadline **/
+  void insert(Timer& timer);
+
+  void unlink(Timer& timer);
+
+  /** Move the timers of a slot down a level, @return the slot index **/
+  u64 cascade(u32 level);
+
+  /** When a level wraps around, bring down the next slot of the level above **/
+  void cascade_due();
+
+};
+
+// ====================================================================== //
+// Class Template Implementation
+// ====================================================================== //
+
+template <typename Function>
+void Timer_wheel::advance(u64 now_ms, Function on_expired) {
+  const u64 now_tick = now_ms / m_tick_ms;
+
+  while (m_current <= now_tick) {
+    if (m_armed == 0) {
+      m_current = now_tick + 1;
+      return;
+    }
+
+    cascade_due();
+
+    Timer*& slot = m_slots[0][m_current & SLOT_MASK];
+    while (slot != nullptr) {
+      Timer& timer = *slot;
+      unlink(timer);
+      if (timer.m_expires > m_current) {
+        // was parked at the top level, not due yet
+        insert(timer);
+        continue;
+      }
+      m_armed--;
+      on_expired(timer);
+    }
+    m_current++;
+  }
+}
+
+#endif //LIGHTCTRL_BACKEND_TIMER_WHEEL_HPP
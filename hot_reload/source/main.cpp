@@ -3,14 +3,21 @@
 // ============================================================ //
 #include "core/console.hpp"
 #include "server/server.hpp"
+#include "server/sharded_server.hpp"
 #include "client/client.hpp"
+#include "core/allocation_counter.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <cstdlib>
+#include <memory>
+#include <vector>
 
 using namespace lightctrl;
 
 constexpr u16 PORT = 1337;
+constexpr const char* QUICK_MATHS_DLL_PATH = "C:/Users/chris/Documents/github/hot_reload/x64/Debug/quick_maths.dll";
 
 // ============================================================ //
 // Functions
@@ -28,14 +35,134 @@ void run_client() {
 }
 
 void run_server() {
-  Server server(PORT);
+  Plugin_host plugin(QUICK_MATHS_DLL_PATH);
+  Executor executor(plugin);
+  Server server(PORT, executor);
 
   while (true) {
     server.run();
-    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(1));
   }
 }
 
+/**
+ * Measure how fast a server accepts connections. A thread opens
+ * connections in rounds while the server accepts them, the clients are
+ * then closed before the next round.
+ */
+void run_accept_benchmark() {
+  constexpr u32 ROUNDS = 20;
+  // stays below the default limit of 1024 open files, counting both ends
+  constexpr u32 CONNECTIONS_PER_ROUND = 400;
+  constexpr s32 RUN_TIMEOUT_MS = 10;
+
+  Plugin_host plugin(QUICK_MATHS_DLL_PATH);
+  Executor executor(plugin);
+  Server server(PORT, executor);
+
+  std::chrono::duration<double> accepting{0};
+  for (u32 round = 0; round < ROUNDS; round++) {
+    std::vector<Tcp_socket> clients;
+    clients.reserve(CONNECTIONS_PER_ROUND);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread connector([&clients] {
+      for (u32 i = 0; i < CONNECTIONS_PER_ROUND; i++) {
+        Tcp_socket client;
+        client.open();
+        client.connect("127.0.0.1", PORT);
+        clients.push_back(std::move(client));
+      }
+    });
+    while (server.client_count() < CONNECTIONS_PER_ROUND) {
+      server.run(RUN_TIMEOUT_MS);
+    }
+    accepting += std::chrono::steady_clock::now() - start;
+
+    connector.join();
+    clients.clear();
+    while (server.client_count() > 0) {
+      server.run(RUN_TIMEOUT_MS);
+    }
+  }
+
+  const u32 total = ROUNDS * CONNECTIONS_PER_ROUND;
+  Console::println(Logger::level::info, "accepted {} connections in {:.3f} s, {:.0f} connections/s",
+                   total, accepting.count(), total / accepting.count());
+}
+
+/**
+ * Run a server on a thread while work runs on the calling thread. The server
+ * thread is joined before returning, so the server is idle afterwards.
+ */
+template <typename Work>
+void run_server_during(Server& server, Work work) {
+  std::atomic<bool> running{true};
+  std::thread server_thread([&server, &running] {
+    while (running) {
+      server.run(Poller::WAIT_FOREVER);
+    }
+  });
+
+  work();
+
+  running = false;
+  server.wake();
+  server_thread.join();
+}
+
+/**
+ * Check that serving binary requests stops allocating once the buffers have
+ * warmed up. A client sends rounds of requests to a server running on a
+ * thread, the allocations the server makes on the request path must not grow
+ * after the warm-up rounds. The counts are read while the server thread is
+ * stopped. Needs a build with LIGHTCTRL_COUNT_ALLOCATIONS.
+ * @return Whether the count stayed the same.
+ */
+bool run_allocation_check() {
+  constexpr u32 WARM_UP_ROUNDS = 3;
+  constexpr u32 ROUNDS = 20;
+  constexpr u32 REQUESTS_PER_ROUND = 200;
+
+  if (!Allocation_counter::ENABLED) {
+    Console::println(Logger::level::warn, "allocation check: build with LIGHTCTRL_COUNT_ALLOCATIONS to count allocations");
+    return false;
+  }
+
+  Plugin_host plugin(QUICK_MATHS_DLL_PATH);
+  Executor executor(plugin);
+  Server server(PORT, executor);
+
+  std::unique_ptr<Client> client;
+  auto ask_rounds = [&client](u32 rounds) {
+    for (u32 round = 0; round < rounds; round++) {
+      for (u32 i = 0; i < REQUESTS_PER_ROUND; i++) client->ask();
+      while (client->pending() > 0) client->listen();
+    }
+  };
+
+  run_server_during(server, [&] {
+    client = std::make_unique<Client>("127.0.0.1", PORT);
+    ask_rounds(WARM_UP_ROUNDS);
+  });
+  const u64 warmed_up = server.request_allocations();
+
+  run_server_during(server, [&] { ask_rounds(ROUNDS - WARM_UP_ROUNDS); });
+  const u64 steady = server.request_allocations() - warmed_up;
+
+  const bool passed = steady == 0;
+  Console::println(passed ? Logger::level::info : Logger::level::err,
+                   "allocation check: {} allocations on the request path after warm-up, {} requests",
+                   steady, (ROUNDS - WARM_UP_ROUNDS) * REQUESTS_PER_ROUND);
+  return passed;
+}
+
+void run_sharded_server() {
+  Plugin_host plugin(QUICK_MATHS_DLL_PATH);
+  Executor executor(plugin, std::max(1u, std::thread::hardware_concurrency()));
+  Sharded_server server(PORT, executor);
+  server.join();
+}
+
 // ============================================================ //
 // Main
 // ============================================================ //
@@ -43,20 +170,33 @@ void run_server() {
 int main(int, char**) {
   Console::set_write_to_file(false);
   Console::println("Project Hot Reload");
-  Console::println("(s)erver or (c)lient.");
+  Console::println("(s)erver, (m)ulti-threaded server, (c)lient, (a)ccept benchmark or a(l)location check.");
   const std::string answer = Console::readln();
 
   Tcp_socket::win_init();
+  int status = 0;
 
   if (answer == "s") {
     run_server();
   }
 
+  else if (answer == "m") {
+    run_sharded_server();
+  }
+
   else if (answer == "c") {
     run_client();
   }
-  
+
+  else if (answer == "a") {
+    run_accept_benchmark();
+  }
+
+  else if (answer == "l") {
+    if (!run_allocation_check()) status = 1;
+  }
+
   Tcp_socket::win_shutdown();
 
-  return 0;
+  return status;
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "packet_decoder.hpp"
+#include <cstring>
+#include <stdexcept>
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  Packet_decoder::Packet_decoder(u64 capacity)
+    : m_buffer(Buffer_pool::make_buffer(capacity)) {}
+
+  // ============================================================ //
+
+  ssize_t Packet_decoder::receive(Tcp_socket& socket) {
+    make_room();
+
+    const ssize_t read_bytes = socket.read(m_buffer.raw() + m_buffer.size(),
+      static_cast<size_t>(m_buffer.capacity() - m_buffer.size()));
+    m_buffer.set_size(m_buffer.size() + read_bytes);
+    return read_bytes;
+  }
+
+  // ============================================================ //
+
+  bool Packet_decoder::next(Tcp_packet& packet) {
+    u8* data = m_buffer.raw() + m_begin;
+    const u64 available = pending();
+
+    // validate as soon as the header is in, not when the whole payload is
+    const u64 packet_size = Tcp_packet::peek_packet_size(data, available);
+    if (packet_size == 0) return false;
+    if (!Tcp_packet::peek_valid_header(data, available)) {
+      throw std::runtime_error("received packet with invalid header");
+    }
+    if (packet_size > available) return false;
+
+    packet = Tcp_packet::make_view(data, packet_size);
+    m_begin += packet_size;
+    return true;
+  }
+
+  // ============================================================ //
+
+  void Packet_decoder::make_room() {
+    const u64 available = pending();
+
+    // everything handed out, start over without copying
+    if (available == 0) {
+      m_begin = 0;
+      m_buffer.set_size(0);
+      return;
+    }
+
+    // a large packet being received, make it fit in one piece
+    const u64 packet_size = Tcp_packet::peek_packet_size(m_buffer.raw() + m_begin, available);
+    if (packet_size > m_buffer.capacity()) {
+      if (m_begin > 0) {
+        std::memmove(m_buffer.raw(), m_buffer.raw() + m_begin, static_cast<size_t>(available));
+        m_begin = 0;
+        m_buffer.set_size(available);
+      }
+      m_buffer.resize(packet_size, true);
+      return;
+    }
+
+    // only move the tail when the rest of the packet does not fit behind it
+    const u64 free = m_buffer.capacity() - m_buffer.size();
+    const u64 missing = packet_size > 0 ? packet_size - available : 1;
+    if (m_begin > 0 && free < missing) {
+      std::memmove(m_buffer.raw(), m_buffer.raw() + m_begin, static_cast<size_t>(available));
+      m_begin = 0;
+      m_buffer.set_size(available);
+    }
+  }
+
+}
@@ -0,0 +1,85 @@
+#ifndef LIGHTCTRL_BACKEND_PACKET_DECODER_HPP
+#define LIGHTCTRL_BACKEND_PACKET_DECODER_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../core/types.hpp"
+#include "../core/buffer.hpp"
+#include "../core/buffer_pool.hpp"
+#include "tcp_socket.hpp"
+#include "tcp_packet.hpp"
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Reassembles Tcp_packets from a stream of reads.
+   *
+   * A read may end in the middle of a packet, or contain several packets.
+   * Received bytes are accumulated in one buffer, and complete packets are
+   * handed out as views into it, so a payload is only copied once, by recv.
+   *
+   *  Usage:
+   *   decoder.receive(socket);
+   *   Tcp_packet packet;
+   *   while (decoder.next(packet)) { ... }
+   */
+  class Packet_decoder {
+
+  public:
+
+    explicit Packet_decoder(u64 capacity = DEFAULT_CAPACITY);
+
+    /**
+     * Read whatever the socket has into the free part of the buffer. Makes
+     * room for the packet currently being received first, which invalidates
+     * packets returned by next.
+     * @throw socket_exception If the read fails or the connection is closed.
+     * @return Bytes read.
+     */
+    ssize_t receive(Tcp_socket& socket);
+
+    /**
+     * Hand out the next complete packet.
+     * @param packet Set to a view into the decoder's buffer, valid until the
+     *               next call to receive.
+     * @throw std::runtime_error If the header of the next packet is invalid,
+     *        the stream can not be recovered and should be closed.
+     * @return False if no complete packet has been received.
+     */
+    bool next(Tcp_packet& packet);
+
+    /** Bytes received but not yet handed out **/
+    u64 pending() const { return m_buffer.size() - m_begin; }
+
+  private:
+
+    /**
+     * Move the unhandled bytes to the front of the buffer, and grow it if
+     * the packet being received does not fit.
+     */
+    void make_room();
+
+  public:
+
+    /** One Buffer_pool block, given back when the connection closes **/
+    static constexpr u64 DEFAULT_CAPACITY = Buffer_pool::BLOCK_SIZE;
+
+  private:
+
+    /** size() is where the next read is stored **/
+    Buffer<u8> m_buffer;
+
+    /** Start of the first packet not yet handed out **/
+    u64 m_begin = 0;
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_PACKET_DECODER_HPP
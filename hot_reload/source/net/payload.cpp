@@ -0,0 +1,109 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "payload.hpp"
+#include "../core/byte_order.hpp"
+#include <charconv>
+
+// ============================================================ //
+// Function Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  namespace {
+
+    constexpr u64 BINARY_INT_SIZE = sizeof(s32);
+
+    /** Decimal integer, the whole of [begin, end) **/
+    bool parse_int(const char* begin, const char* end, int& value) {
+      const auto parsed = std::from_chars(begin, end, value);
+      return parsed.ec == std::errc() && parsed.ptr == end && begin != end;
+    }
+
+  }
+
+  // ============================================================ //
+
+  const char* get_encoding_as_string(Payload_encoding encoding) {
+    switch (encoding) {
+      case Payload_encoding::TEXT: return "text";
+      case Payload_encoding::BINARY: return "binary";
+      default: return "invalid";
+    }
+  }
+
+  // ============================================================ //
+
+  Payload_encoding decode_encoding(const u8* data, u64 size) {
+    if (size != 1 || data[0] >= static_cast<u8>(Payload_encoding::VALID_ENCODING_HELPER)) {
+      return Payload_encoding::TEXT;
+    }
+    return static_cast<Payload_encoding>(data[0]);
+  }
+
+  // ============================================================ //
+
+  u64 encode_request(Payload_encoding encoding, int a, int b, u8* out) {
+    if (encoding == Payload_encoding::BINARY) {
+      store_le<s32>(out, a);
+      store_le<s32>(out + BINARY_INT_SIZE, b);
+      return 2 * BINARY_INT_SIZE;
+    }
+
+    char* text = reinterpret_cast<char*>(out);
+    char* const end = text + MAX_REQUEST_PAYLOAD_SIZE;
+    text = std::to_chars(text, end, a).ptr;
+    *text++ = ',';
+    text = std::to_chars(text, end, b).ptr;
+    return static_cast<u64>(text - reinterpret_cast<char*>(out));
+  }
+
+  // ============================================================ //
+
+  bool decode_request(Payload_encoding encoding, const u8* data, u64 size,
+                      int& a, int& b) {
+    if (encoding == Payload_encoding::BINARY) {
+      if (size != 2 * BINARY_INT_SIZE) return false;
+      a = load_le<s32>(data);
+      b = load_le<s32>(data + BINARY_INT_SIZE);
+      return true;
+    }
+
+    const char* text = reinterpret_cast<const char*>(data);
+    const char* const end = text + size;
+    const char* comma = text;
+    while (comma != end && *comma != ',') comma++;
+    if (comma == end) return false;
+    return parse_int(text, comma, a) && parse_int(comma + 1, end, b);
+  }
+
+  // ============================================================ //
+
+  u64 encode_response(Payload_encoding encoding, int result, u8* out) {
+    if (encoding == Payload_encoding::BINARY) {
+      store_le<s32>(out, result);
+      return BINARY_INT_SIZE;
+    }
+
+    char* text = reinterpret_cast<char*>(out);
+    const char* end = std::to_chars(text, text + MAX_RESPONSE_PAYLOAD_SIZE, result).ptr;
+    return static_cast<u64>(end - text);
+  }
+
+  // ============================================================ //
+
+  bool decode_response(Payload_encoding encoding, const u8* data, u64 size,
+                       int& result) {
+    if (encoding == Payload_encoding::BINARY) {
+      if (size != BINARY_INT_SIZE) return false;
+      result = load_le<s32>(data);
+      return true;
+    }
+
+    const char* text = reinterpret_cast<const char*>(data);
+    return parse_int(text, text + size, result);
+  }
+
+}
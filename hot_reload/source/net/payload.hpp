@@ -0,0 +1,80 @@
+#ifndef LIGHTCTRL_BACKEND_PAYLOAD_HPP
+#define LIGHTCTRL_BACKEND_PAYLOAD_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../core/types.hpp"
+
+// ============================================================ //
+// Data types
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * How the operands of a REQUEST and the result of a RESPONSE are encoded.
+   *
+   * A connection starts out as TEXT. The client may ask for another encoding
+   * with a HANDSHAKE packet holding the encoding as one byte, the server
+   * answers with a HANDSHAKE holding the encoding it will use from then on.
+   */
+  enum class Payload_encoding : u8 {
+    /** "a,b" and "result" in decimal, readable when debugging **/
+    TEXT = 0,
+    /** a and b as two 32-bit little-endian integers, the result as one **/
+    BINARY,
+
+    // used to validate encodings, lower values are valid.
+    VALID_ENCODING_HELPER
+  };
+
+}
+
+// ============================================================ //
+// Functions
+// ============================================================ //
+
+namespace lightctrl {
+
+  /** Large enough for an encoded request in any encoding **/
+  static constexpr u64 MAX_REQUEST_PAYLOAD_SIZE = 24;
+
+  /** Large enough for an encoded response in any encoding **/
+  static constexpr u64 MAX_RESPONSE_PAYLOAD_SIZE = 12;
+
+  const char* get_encoding_as_string(Payload_encoding encoding);
+
+  /** @return The encoding in a HANDSHAKE payload, TEXT if not valid **/
+  Payload_encoding decode_encoding(const u8* data, u64 size);
+
+  /**
+   * @param out At least MAX_REQUEST_PAYLOAD_SIZE bytes.
+   * @return Bytes written.
+   */
+  u64 encode_request(Payload_encoding encoding, int a, int b, u8* out);
+
+  /**
+   * Does not allocate or throw.
+   * @return False if the payload is not a request in the encoding.
+   */
+  bool decode_request(Payload_encoding encoding, const u8* data, u64 size,
+                      int& a, int& b);
+
+  /**
+   * @param out At least MAX_RESPONSE_PAYLOAD_SIZE bytes.
+   * @return Bytes written.
+   */
+  u64 encode_response(Payload_encoding encoding, int result, u8* out);
+
+  /**
+   * Does not allocate or throw.
+   * @return False if the payload is not a response in the encoding.
+   */
+  bool decode_response(Payload_encoding encoding, const u8* data, u64 size,
+                       int& result);
+
+}
+
+#endif //LIGHTCTRL_BACKEND_PAYLOAD_HPP
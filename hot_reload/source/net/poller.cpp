@@ -0,0 +1,255 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "poller.hpp"
+#include <algorithm>
+
+#if defined(LIGHTCTRL_PLATFORM_LINUX)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+#if defined(LIGHTCTRL_PLATFORM_LINUX)
+
+  static u32 to_epoll_events(Poller::interest interest_mask) {
+    u32 events = 0;
+    if (interest_mask & Poller::INTEREST_READ) events |= EPOLLIN;
+    if (interest_mask & Poller::INTEREST_WRITE) events |= EPOLLOUT;
+    return events;
+  }
+
+  // ============================================================ //
+
+  Poller::Poller() : m_epoll(epoll_create1(EPOLL_CLOEXEC)) {
+    if (m_epoll == -1) {
+      throw socket_exception("failed to create epoll instance");
+    }
+
+    m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake == -1) {
+      ::close(m_epoll);
+      throw socket_exception("failed to create poller wake up event");
+    }
+    add(m_wake, WAKE_KEY, INTEREST_READ);
+
+    m_events.reserve(MAX_EVENTS_PER_WAIT);
+  }
+
+  // ============================================================ //
+
+  Poller::~Poller() {
+    ::close(m_wake);
+    ::close(m_epoll);
+  }
+
+  // ============================================================ //
+
+  void Poller::add(chif_socket socket, u64 key, interest interest_mask) {
+    epoll_event event{};
+    event.events = to_epoll_events(interest_mask);
+    event.data.u64 = key;
+
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &event) == -1) {
+      throw socket_exception("failed to add socket to poller");
+    }
+  }
+
+  // ============================================================ //
+
+  void Poller::modify(chif_socket socket, u64 key, interest interest_mask) {
+    epoll_event event{};
+    event.events = to_epoll_events(interest_mask);
+    event.data.u64 = key;
+
+    if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, socket, &event) == -1) {
+      throw socket_exception("failed to modify socket in poller");
+    }
+  }
+
+  // ============================================================ //
+
+  void Poller::remove(chif_socket socket) {
+    // fails only if the socket was never added, nothing to do then
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, socket, nullptr);
+  }
+
+  // ============================================================ //
+
+  const std::vector<Poller::Event>& Poller::wait(s32 timeout_ms) {
+    epoll_event ready[MAX_EVENTS_PER_WAIT];
+    m_events.clear();
+
+    const int count = epoll_wait(m_epoll, ready, MAX_EVENTS_PER_WAIT, timeout_ms);
+    if (count == -1) {
+      if (errno == EINTR) return m_events;
+      throw socket_exception("failed to wait on poller");
+    }
+
+    for (int i = 0; i < count; i++) {
+      if (ready[i].data.u64 == WAKE_KEY) {
+        drain_wake();
+        continue;
+      }
+
+      Event event{};
+      event.key = ready[i].data.u64;
+      event.readable = (ready[i].events & EPOLLIN) != 0;
+      event.writable = (ready[i].events & EPOLLOUT) != 0;
+      event.error = (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+      m_events.push_back(event);
+    }
+
+    return m_events;
+  }
+
+  // ============================================================ //
+
+  void Poller::wake() {
+    const u64 one = 1;
+    // only fails if the counter is about to overflow, then a wake up is pending anyway
+    (void)::write(m_wake, &one, sizeof(one));
+  }
+
+  // ============================================================ //
+
+  void Poller::drain_wake() {
+    u64 count;
+    (void)::read(m_wake, &count, sizeof(count));
+  }
+
+#else
+
+  Poller::Poller() {
+    // there is no eventfd, use a loopback udp socket that sends to itself
+    auto res = chif_net_open_socket(&m_wake, CHIF_PROTOCOL_UDP, CHIF_ADDRESS_FAMILY_IPV4);
+    if (res != CHIF_RESULT_SUCCESS) {
+      throw socket_exception("failed to create poller wake up socket");
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_len = sizeof(address);
+    if (::bind(m_wake, reinterpret_cast<sockaddr*>(&address), address_len) == CHIF_SOCKET_ERROR ||
+        getsockname(m_wake, reinterpret_cast<sockaddr*>(&address), &address_len) == CHIF_SOCKET_ERROR ||
+        ::connect(m_wake, reinterpret_cast<sockaddr*>(&address), address_len) == CHIF_SOCKET_ERROR) {
+      chif_net_close_socket(&m_wake);
+      throw socket_exception("failed to create poller wake up socket");
+    }
+    chif_net_set_socket_blocking(m_wake, CHIF_FALSE);
+    add(m_wake, WAKE_KEY, INTEREST_READ);
+
+    m_events.reserve(MAX_EVENTS_PER_WAIT);
+  }
+
+  // ============================================================ //
+
+  Poller::~Poller() {
+    chif_net_close_socket(&m_wake);
+  }
+
+  // ============================================================ //
+
+  void Poller::add(chif_socket socket, u64 key, interest interest_mask) {
+    if (m_registrations.size() >= FD_SETSIZE) {
+      throw socket_exception("failed to add socket to poller, too many sockets");
+    }
+    m_registrations.push_back(Registration{socket, key, interest_mask});
+  }
+
+  // ============================================================ //
+
+  void Poller::modify(chif_socket socket, u64 key, interest interest_mask) {
+    for (auto& registration : m_registrations) {
+      if (registration.socket == socket) {
+        registration.key = key;
+        registration.interest_mask = interest_mask;
+        return;
+      }
+    }
+    throw socket_exception("failed to modify socket in poller");
+  }
+
+  // ============================================================ //
+
+  void Poller::remove(chif_socket socket) {
+    m_registrations.erase(std::remove_if(m_registrations.begin(), m_registrations.end(),
+      [socket](const Registration& registration) {
+      return registration.socket == socket;
+    }), m_registrations.end());
+  }
+
+  // ============================================================ //
+
+  const std::vector<Poller::Event>& Poller::wait(s32 timeout_ms) {
+    fd_set read_set;
+    fd_set write_set;
+    fd_set error_set;
+    FD_ZERO(&read_set);
+    FD_ZERO(&write_set);
+    FD_ZERO(&error_set);
+    m_events.clear();
+
+    chif_socket max_socket = 0;
+    for (const auto& registration : m_registrations) {
+      if (registration.interest_mask & INTEREST_READ) FD_SET(registration.socket, &read_set);
+      if (registration.interest_mask & INTEREST_WRITE) FD_SET(registration.socket, &write_set);
+      FD_SET(registration.socket, &error_set);
+      max_socket = std::max(max_socket, registration.socket);
+    }
+
+    TIMEVAL timeout{};
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    const int count = select(static_cast<int>(max_socket) + 1, &read_set, &write_set,
+                             &error_set, timeout_ms == WAIT_FOREVER ? nullptr : &timeout);
+    if (count == CHIF_SOCKET_ERROR) {
+      throw socket_exception("failed to wait on poller");
+    }
+
+    for (const auto& registration : m_registrations) {
+      if (registration.key == WAKE_KEY) {
+        if (FD_ISSET(registration.socket, &read_set)) drain_wake();
+        continue;
+      }
+
+      Event event{};
+      event.key = registration.key;
+      event.readable = FD_ISSET(registration.socket, &read_set) != 0;
+      event.writable = FD_ISSET(registration.socket, &write_set) != 0;
+      event.error = FD_ISSET(registration.socket, &error_set) != 0;
+      if (event.readable || event.writable || event.error) {
+        m_events.push_back(event);
+      }
+    }
+
+    return m_events;
+  }
+
+  // ============================================================ //
+
+  void Poller::wake() {
+    const u8 one = 1;
+    ssize_t sent_bytes;
+    chif_net_write(m_wake, &one, sizeof(one), &sent_bytes);
+  }
+
+  // ============================================================ //
+
+  void Poller::drain_wake() {
+    u8 buffer[64];
+    ssize_t read_bytes;
+    while (chif_net_read(m_wake, buffer, sizeof(buffer), &read_bytes) == CHIF_RESULT_SUCCESS);
+  }
+
+#endif
+
+}
@@ -0,0 +1,148 @@
+#ifndef LIGHTCTRL_BACKEND_POLLER_HPP
+#define LIGHTCTRL_BACKEND_POLLER_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "tcp_socket.hpp"
+#include "../core/types.hpp"
+#include <vector>
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Readiness notification for a set of sockets.
+   *
+   * Sockets are registered once together with a key, a call to wait() will
+   * then block until at least one of them is ready and only report the ready
+   * ones, tagged with their key. Backed by epoll (level-triggered) on Linux,
+   * and by a single select() over all registered sockets elsewhere.
+   *
+   * Another thread can interrupt a wait() with wake().
+   */
+  class Poller {
+
+    // ====================================================================== //
+    // Data Types Declaration
+    // ====================================================================== //
+
+  public:
+
+    using interest = u8;
+    static constexpr interest INTEREST_NONE = 0;
+    static constexpr interest INTEREST_READ = 1;
+    static constexpr interest INTEREST_WRITE = 2;
+
+    struct Event {
+      u64 key;
+      bool readable;
+      bool writable;
+      /** Hang up or error on the socket, a read will tell which **/
+      bool error;
+    };
+
+    /** Used as timeout to wait() to block until something happens **/
+    static constexpr s32 WAIT_FOREVER = -1;
+
+  private:
+
+#if !defined(LIGHTCTRL_PLATFORM_LINUX)
+    struct Registration {
+      chif_socket socket;
+      u64 key;
+      interest interest_mask;
+    };
+#endif
+
+    // ====================================================================== //
+    // Variables and Constants
+    // ====================================================================== //
+
+  private:
+
+    static constexpr u32 MAX_EVENTS_PER_WAIT = 256;
+
+    /** Key of the internal wake up handle, never reported by wait() **/
+    static constexpr u64 WAKE_KEY = ~0ULL - 1;
+
+#if defined(LIGHTCTRL_PLATFORM_LINUX)
+    int m_epoll = -1;
+    /** eventfd **/
+    int m_wake = -1;
+#else
+    std::vector<Registration> m_registrations;
+    /** udp socket connected to itself **/
+    chif_socket m_wake = CHIF_INVALID_SOCKET;
+#endif
+
+    std::vector<Event> m_events;
+
+    // ====================================================================== //
+    // Lifetime Methods
+    // ====================================================================== //
+
+  public:
+
+    /**
+     * Will throw on failure.
+     */
+    Poller();
+
+    ~Poller();
+
+    Poller(const Poller& other) = delete;
+
+    Poller& operator=(const Poller& other) = delete;
+
+    // ====================================================================== //
+    // Public Methods
+    // ====================================================================== //
+
+  public:
+
+    /**
+     * Start watching a socket.
+     * Will throw on failure.
+     * @param key Reported back in Event::key when the socket is ready.
+     */
+    void add(chif_socket socket, u64 key, interest interest_mask);
+
+    /**
+     * Change what we are watching the socket for.
+     * Will throw on failure.
+     */
+    void modify(chif_socket socket, u64 key, interest interest_mask);
+
+    /**
+     * Stop watching the socket. Must be called before the socket is closed.
+     */
+    void remove(chif_socket socket);
+
+    /**
+     * Block until at least one socket is ready, or timeout has passed.
+     * Will throw on failure.
+     * @param timeout_ms Milliseconds, or WAIT_FOREVER.
+     * @return The ready sockets, valid until next call to wait.
+     */
+    const std::vector<Event>& wait(s32 timeout_ms);
+
+    /**
+     * Make a blocked, or the next, call to wait() return. Thread-safe.
+     */
+    void wake();
+
+  private:
+
+    /** Consume pending wake ups **/
+    void drain_wake();
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_POLLER_HPP
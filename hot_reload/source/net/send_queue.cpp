@@ -0,0 +1,126 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "send_queue.hpp"
+#include <algorithm>
+#include <cstring>
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  Send_queue::Send_queue(u64 capacity)
+    : m_buffer(Buffer_pool::make_buffer(capacity)) {}
+
+  // ============================================================ //
+
+  void Send_queue::push(Tcp_packet& packet) {
+    const Buffer<u8>& bytes = packet.get_buffer();
+    std::memcpy(append(bytes.size()), bytes.raw(), static_cast<size_t>(bytes.size()));
+  }
+
+  // ============================================================ //
+
+  void Send_queue::push(Tcp_packet::Header header, const u8* payload, u64 size) {
+    header.payload_size = static_cast<u32>(size);
+    u8* data = append(Tcp_packet::HEADER_SIZE + size);
+    Tcp_packet::write_header(header, data);
+    if (size > 0) {
+      std::memcpy(data + Tcp_packet::HEADER_SIZE, payload, static_cast<size_t>(size));
+    }
+  }
+
+  // ============================================================ //
+
+  u64 Send_queue::send(Tcp_socket& socket, Tcp_packet::Header header,
+                       const u8* payload, u64 size) {
+    if (size < GATHER_THRESHOLD) {
+      push(header, payload, size);
+      return 0;
+    }
+
+    header.payload_size = static_cast<u32>(size);
+    u8 header_bytes[Tcp_packet::HEADER_SIZE];
+    Tcp_packet::write_header(header, header_bytes);
+
+    const u64 queued = this->size();
+    const chif_net_slice slices[] = {
+      {m_buffer.raw() + m_begin, static_cast<size_t>(queued)},
+      {header_bytes, static_cast<size_t>(Tcp_packet::HEADER_SIZE)},
+      {payload, static_cast<size_t>(size)},
+    };
+    const ssize_t written = socket.write(slices, 3);
+    const u64 sent = written > 0 ? static_cast<u64>(written) : 0;
+
+    // keep what the socket did not take, in order behind the queued bytes
+    if (sent < queued) {
+      consume(sent);
+      std::memcpy(append(Tcp_packet::HEADER_SIZE), header_bytes, sizeof(header_bytes));
+      std::memcpy(append(size), payload, static_cast<size_t>(size));
+      return sent;
+    }
+    consume(queued);
+
+    u64 offset = sent - queued;
+    if (offset < Tcp_packet::HEADER_SIZE) {
+      const u64 rest = Tcp_packet::HEADER_SIZE - offset;
+      std::memcpy(append(rest), header_bytes + offset, static_cast<size_t>(rest));
+      offset = 0;
+    }
+    else {
+      offset -= Tcp_packet::HEADER_SIZE;
+    }
+    if (offset < size) {
+      std::memcpy(append(size - offset), payload + offset, static_cast<size_t>(size - offset));
+    }
+    return sent;
+  }
+
+  // ============================================================ //
+
+  u64 Send_queue::flush(Tcp_socket& socket) {
+    const u64 queued = size();
+    while (!empty()) {
+      const ssize_t sent_bytes = socket.write(m_buffer.raw() + m_begin, static_cast<size_t>(size()));
+      if (sent_bytes <= 0) return queued - size();
+      consume(static_cast<u64>(sent_bytes));
+    }
+    return queued;
+  }
+
+  // ============================================================ //
+
+  u8* Send_queue::append(u64 bytes) {
+    const u64 queued = size();
+
+    if (m_buffer.capacity() - m_buffer.size() < bytes) {
+      // move what is left to the front, grow if that is not enough
+      if (m_begin > 0) {
+        std::memmove(m_buffer.raw(), m_buffer.raw() + m_begin, static_cast<size_t>(queued));
+        m_begin = 0;
+        m_buffer.set_size(queued);
+      }
+      if (m_buffer.capacity() - queued < bytes) {
+        m_buffer.resize(std::max(m_buffer.capacity() * 2, queued + bytes), true);
+      }
+    }
+
+    u8* data = m_buffer.raw() + m_buffer.size();
+    m_buffer.set_size(m_buffer.size() + bytes);
+    return data;
+  }
+
+  // ============================================================ //
+
+  void Send_queue::consume(u64 bytes) {
+    m_begin += bytes;
+    if (m_begin == m_buffer.size()) {
+      m_begin = 0;
+      m_buffer.set_size(0);
+    }
+  }
+
+}
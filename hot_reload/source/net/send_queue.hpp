@@ -0,0 +1,96 @@
+#ifndef LIGHTCTRL_BACKEND_SEND_QUEUE_HPP
+#define LIGHTCTRL_BACKEND_SEND_QUEUE_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../core/types.hpp"
+#include "../core/buffer.hpp"
+#include "../core/buffer_pool.hpp"
+#include "tcp_socket.hpp"
+#include "tcp_packet.hpp"
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Outbound bytes of a non-blocking socket.
+   *
+   * Packets are appended to one buffer, flush sends as much as the socket
+   * takes and keeps the rest for when the socket is writable again.
+   *
+   * A packet may also be given as a header and a payload the caller owns.
+   * Small ones are written straight into the buffer and go out with the
+   * next flush, large ones go to the socket at once in a gathered write
+   * and only what the socket does not take is copied.
+   */
+  class Send_queue {
+
+  public:
+
+    explicit Send_queue(u64 capacity = DEFAULT_CAPACITY);
+
+    /** Queue a copy of the whole packet, header and payload **/
+    void push(Tcp_packet& packet);
+
+    /**
+     * Queue a packet without building a Tcp_packet, the header is written
+     * into the queue and payload_size is taken from size.
+     */
+    void push(Tcp_packet::Header header, const u8* payload, u64 size);
+
+    /**
+     * Queue a packet like push if the payload is smaller than
+     * GATHER_THRESHOLD. Otherwise write the queued bytes, the header and the
+     * payload in one call, the payload is only copied if the socket does not
+     * take all of it.
+     * @throw socket_exception If the write fails.
+     * @return Bytes sent.
+     */
+    u64 send(Tcp_socket& socket, Tcp_packet::Header header, const u8* payload, u64 size);
+
+    /**
+     * Send queued bytes until the queue is empty or the socket is full.
+     * @throw socket_exception If the write fails.
+     * @return Bytes sent.
+     */
+    u64 flush(Tcp_socket& socket);
+
+    /** Bytes queued but not yet sent **/
+    u64 size() const { return m_buffer.size() - m_begin; }
+
+    bool empty() const { return size() == 0; }
+
+  public:
+
+    /** One Buffer_pool block, given back when the connection closes **/
+    static constexpr u64 DEFAULT_CAPACITY = Buffer_pool::BLOCK_SIZE;
+
+    /** Below this a payload is cheaper to copy than to send on its own **/
+    static constexpr u64 GATHER_THRESHOLD = 16 * 1024;
+
+  private:
+
+    /** Make room for bytes more at the end, the queue size grows by bytes **/
+    u8* append(u64 bytes);
+
+    /** Drop the first bytes queued, they were sent **/
+    void consume(u64 bytes);
+
+  private:
+
+    /** size() is where the next packet is appended **/
+    Buffer<u8> m_buffer;
+
+    /** First byte not yet sent **/
+    u64 m_begin = 0;
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_SEND_QUEUE_HPP
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
 #include "tcp_packet.hpp"
+#include "../core/byte_order.hpp"
+#include "../core/buffer_pool.hpp"
 
 // ====================================================================== //
 // Class Implementation
@@ -21,7 +24,7 @@ Tcp_packet::Tcp_packet() : m_packet() {}
 // ============================================================ //
 
 Tcp_packet::Tcp_packet(Packet_signature packet_signature, u64 capacity)
-        : m_packet(capacity) {
+        : m_packet(Buffer_pool::make_buffer(std::max<u64>(capacity, HEADER_SIZE))) {
   clear_header();
   set_signature(packet_signature);
 }
@@ -29,7 +32,7 @@ Tcp_packet::Tcp_packet(Packet_signature packet_signature, u64 capacity)
 // ============================================================ //
 
 Tcp_packet::Tcp_packet(Packet_signature packet_signature, const Buffer<u8>& payload)
-        : m_packet(payload.size() + sizeof(Header)) {
+        : m_packet(Buffer_pool::make_buffer(payload.size() + HEADER_SIZE)) {
   clear_header();
   write_payload_and_update_size(payload);
   set_signature(packet_signature);
@@ -39,7 +42,7 @@ Tcp_packet::Tcp_packet(Packet_signature packet_signature, const Buffer<u8>& payl
 
 Tcp_packet::Tcp_packet(Tcp_packet::Packet_signature packet_signature,
                        const u8 *payload, u64 size)
-: m_packet(size + sizeof(Header)) {
+: m_packet(Buffer_pool::make_buffer(size + HEADER_SIZE)) {
   clear_header();
   write_payload_and_update_size(payload, size);
   set_signature(packet_signature);
@@ -47,9 +50,17 @@ Tcp_packet::Tcp_packet(Tcp_packet::Packet_signature packet_signature,
 
 // ============================================================ //
 
-Buffer<u8>&& Tcp_packet::get_payload() {
+Tcp_packet Tcp_packet::make_view(u8* data, u64 size) {
+  Tcp_packet packet;
+  packet.m_packet = Buffer<u8>(data, size, size, false);
+  return packet;
+}
+
+// ============================================================ //
+
+Buffer<u8> Tcp_packet::get_payload() {
   if (!m_packet.size()) throw std::runtime_error("cannot read payload from an empty packet");
-  return m_packet.make_sub_buffer(sizeof(Header));
+  return m_packet.make_sub_buffer(PAYLOAD_OFFSET);
 }
 
 // ============================================================ //
@@ -75,28 +86,27 @@ void Tcp_packet::set_payload(const u8* payload, u64 size) {
 
 Tcp_packet::Packet_signature Tcp_packet::get_signature() const {
   if (!m_packet.size()) throw std::runtime_error("cannot read signature from an empty packet");
-  const Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  return static_cast<Packet_signature>(header->signature);
+  return static_cast<Packet_signature>(m_packet.raw()[SIGNATURE_OFFSET]);
 }
 
 // ============================================================ //
 
 const char* Tcp_packet::get_signature_as_string() const {
-  if (!m_packet.size()) throw std::runtime_error("cannot read signature from an empty packet");
-  const Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  return Packet_signature_string_name[header->signature];
+  const Packet_signature signature = get_signature();
+  if (!valid_signature(signature)) return Packet_signature_string_name[0];
+  return Packet_signature_string_name[static_cast<u8>(signature)];
 }
 
 // ============================================================ //
 
 void Tcp_packet::set_signature(Packet_signature packet_signature) {
   if (!m_packet.capacity()) {
-    m_packet.resize(sizeof(Header), true);
+    m_packet.resize(HEADER_SIZE, true);
+    clear_header();
   }
 
   if (!valid_signature(packet_signature)) packet_signature = Packet_signature::INVALID;
-  Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  header->signature = static_cast<u8>(packet_signature);
+  m_packet.raw()[SIGNATURE_OFFSET] = static_cast<u8>(packet_signature);
 }
 
 // ============================================================ //
@@ -107,10 +117,68 @@ u64 Tcp_packet::get_packet_size() const {
 
 // ============================================================ //
 
-u16 Tcp_packet::get_payload_size() const {
+u32 Tcp_packet::get_payload_size() const {
   if (!m_packet.size()) throw std::runtime_error("cannot read size from an empty packet");
-  const Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  return header->payload_size;
+  return load_le<u32>(m_packet.raw() + PAYLOAD_SIZE_OFFSET);
+}
+
+// ============================================================ //
+
+u16 Tcp_packet::get_flags() const {
+  if (!m_packet.size()) throw std::runtime_error("cannot read flags from an empty packet");
+  return load_le<u16>(m_packet.raw() + FLAGS_OFFSET);
+}
+
+// ============================================================ //
+
+void Tcp_packet::set_flags(u16 flags) {
+  if (m_packet.capacity() < PAYLOAD_OFFSET) return;
+  store_le(m_packet.raw() + FLAGS_OFFSET, flags);
+}
+
+// ============================================================ //
+
+u32 Tcp_packet::get_request_id() const {
+  if (!m_packet.size()) throw std::runtime_error("cannot read request id from an empty packet");
+  return load_le<u32>(m_packet.raw() + REQUEST_ID_OFFSET);
+}
+
+// ============================================================ //
+
+void Tcp_packet::set_request_id(u32 request_id) {
+  if (m_packet.capacity() < PAYLOAD_OFFSET) return;
+  store_le(m_packet.raw() + REQUEST_ID_OFFSET, request_id);
+}
+
+// ============================================================ //
+
+u64 Tcp_packet::peek_packet_size(const u8* data, u64 size) {
+  if (size < PAYLOAD_OFFSET) return 0;
+  return PAYLOAD_OFFSET + load_le<u32>(data + PAYLOAD_SIZE_OFFSET);
+}
+
+// ============================================================ //
+
+bool Tcp_packet::peek_valid_header(const u8* data, u64 size) {
+  if (size < PAYLOAD_OFFSET) return false;
+  const Header header = read_header(data);
+  return header.version == VERSION &&
+         valid_signature(static_cast<Packet_signature>(header.signature)) &&
+         header.payload_size <= MAX_PAYLOAD_SIZE;
+}
+
+// ============================================================ //
+
+bool Tcp_packet::valid_header() const {
+  if (!peek_valid_header(m_packet.raw(), m_packet.size())) {
+    return false;
+  }
+
+  if (PAYLOAD_OFFSET + get_payload_size() != m_packet.size()) {
+    return false;
+  }
+
+  return true;
 }
 
 // ============================================================ //
@@ -125,15 +193,34 @@ Buffer<u8> &Tcp_packet::get_buffer() {
 
 // ============================================================ //
 
-Tcp_packet::Header Tcp_packet::get_header() {
-  Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  return *header;
+Tcp_packet::Header Tcp_packet::get_header() const {
+  return read_header(m_packet.raw());
 }
 
 void Tcp_packet::set_header(const Tcp_packet::Header& new_header) {
-  Header* header = reinterpret_cast<Header*>(m_packet.raw());
-  header->signature = new_header.signature;
-  header->payload_size = new_header.payload_size;
+  write_header(new_header, m_packet.raw());
+}
+
+// ============================================================ //
+
+Tcp_packet::Header Tcp_packet::read_header(const u8* data) {
+  Header header;
+  header.version = data[VERSION_OFFSET];
+  header.signature = data[SIGNATURE_OFFSET];
+  header.flags = load_le<u16>(data + FLAGS_OFFSET);
+  header.payload_size = load_le<u32>(data + PAYLOAD_SIZE_OFFSET);
+  header.request_id = load_le<u32>(data + REQUEST_ID_OFFSET);
+  return header;
+}
+
+// ============================================================ //
+
+void Tcp_packet::write_header(const Header& header, u8* data) {
+  data[VERSION_OFFSET] = header.version;
+  data[SIGNATURE_OFFSET] = header.signature;
+  store_le(data + FLAGS_OFFSET, header.flags);
+  store_le(data + PAYLOAD_SIZE_OFFSET, header.payload_size);
+  store_le(data + REQUEST_ID_OFFSET, header.request_id);
 }
 
 // ====================================================================== //
@@ -141,45 +228,43 @@ void Tcp_packet::set_header(const Tcp_packet::Header& new_header) {
 // ====================================================================== //
 
 void Tcp_packet::write_payload_and_update_size(const Buffer<u8> &payload) {
-  if (payload.size() + PAYLOAD_OFFSET > m_packet.capacity()) {
-    if (payload.size() + PAYLOAD_OFFSET > get_total_max_size()) {
-      throw std::runtime_error("payload too large for the tcp packet to carry."
-      " You need to increase the size parameter in the header of the tcp_packet.");
-    }
-    m_packet.resize(payload.size() + PAYLOAD_OFFSET, false);
-  }
-
-  m_packet.copy_set(payload.raw(), payload.size() + PAYLOAD_OFFSET,
-                    payload.size() + PAYLOAD_OFFSET, PAYLOAD_OFFSET);
-  set_payload_size(static_cast<u16>(payload.size())); // type mismatch note: will fit, else throws runtime_error
+  write_payload_and_update_size(payload.raw(), payload.size());
 }
 
 // ============================================================ //
 
 void Tcp_packet::write_payload_and_update_size(const u8* payload, u64 size) {
-  if (size + PAYLOAD_OFFSET > m_packet.size() &&
-          m_packet.size() < get_total_max_size()) {
-    m_packet.resize(size + PAYLOAD_OFFSET, false);
+  if (size + PAYLOAD_OFFSET > get_total_max_size()) {
+    throw std::runtime_error("payload too large for the tcp packet to carry.");
   }
 
-  m_packet.copy_set(payload, size + PAYLOAD_OFFSET,
-                    size + PAYLOAD_OFFSET, PAYLOAD_OFFSET);
-  set_payload_size(static_cast<u16>(size));
+  const Header header = m_packet.capacity() >= PAYLOAD_OFFSET ? get_header() : Header();
+
+  // write in place when the payload fits, the payload may be our own
+  if (!m_packet.owns_buffer() || m_packet.capacity() < size + PAYLOAD_OFFSET) {
+    Buffer<u8> packet = Buffer_pool::make_buffer(size + PAYLOAD_OFFSET);
+    std::memcpy(packet.raw() + PAYLOAD_OFFSET, payload, static_cast<size_t>(size));
+    m_packet = std::move(packet);
+  }
+  else {
+    std::memmove(m_packet.raw() + PAYLOAD_OFFSET, payload, static_cast<size_t>(size));
+  }
+  m_packet.set_size(size + PAYLOAD_OFFSET);
+  set_header(header);
+  set_payload_size(static_cast<u32>(size));
 }
 
 // ============================================================ //
 
 u64 Tcp_packet::get_total_max_size() {
-  return (1UL << sizeof(u16)*8) - 1 + PAYLOAD_OFFSET;
+  return MAX_PAYLOAD_SIZE + PAYLOAD_OFFSET;
 }
 
 // ============================================================ //
 
-void Tcp_packet::set_payload_size(u16 payload_size) {
+void Tcp_packet::set_payload_size(u32 payload_size) {
   if (m_packet.size() < PAYLOAD_OFFSET) return;
-  Header* header = reinterpret_cast<Header*>(m_packet.raw());
-
-  header->payload_size = payload_size;
+  store_le(m_packet.raw() + PAYLOAD_SIZE_OFFSET, payload_size);
 }
 
 // ============================================================ //
@@ -190,20 +275,6 @@ bool Tcp_packet::valid_signature(Tcp_packet::Packet_signature packet_signature)
 
 // ============================================================ //
 
-bool Tcp_packet::valid_header() {
-  const Header* header = reinterpret_cast<Header*>(m_packet.raw());
-
-  if (!valid_signature(static_cast<Packet_signature>(header->signature))) {
-    return false;
-  }
-
-  if (header->payload_size > m_packet.size()) {
-    return false;
-  }
-
-  return true;
-}
-
 void Tcp_packet::clear_header() {
-  memset(m_packet.raw(), 0, sizeof(Header));
+  write_header(Header(), m_packet.raw());
 }
@@ -20,19 +20,29 @@
  *  | header | payload ... |
  *  |________|_____________|
  *
- *  Header:
- *   _________________________
- *  |signature | payload size |
- *  |__________|______________|
+ *  Header, 12 bytes, integers little-endian:
+ *   ____________________________________________________________
+ *  | version | signature | flags | payload size | request id |
+ *  |   u8    |    u8     |  u16  |     u32      |    u32     |
+ *  |_________|___________|_______|______________|____________|
  *
- *  The header contains a type, and a paylaod size.
- *  The type tells us how the packet should be handled.
+ *  The version tells which layout the header has, a packet of another
+ *  version is not valid.
+ *  The signature tells us how the packet should be handled.
+ *  The flags are reserved for the signature to use.
  *  The payload size tells us how long the payload is. This is useful
  *  for when receiving a packet that is longer than the maximum ethernet/wifi
  *  packet size.
+ *  The request id is chosen by the client, and repeated in the response.
+ *
+ *  The header is written byte by byte, it has no padding and reads the same
+ *  on every architecture.
  *
  *  Payload:
  *  This simply contains the applications payload.
+ *
+ *  Packets that fit in a Buffer_pool block are built in one, and setting a
+ *  payload that fits reuses the buffer instead of allocating a new one.
  */
 class Tcp_packet {
 
@@ -55,6 +65,26 @@ public:
     VALID_PACKET_SIGNATURE_HELPER
   };
 
+  /** Layout of the header on the wire, increased when it changes **/
+  static constexpr u8 VERSION = 1;
+
+  /** Packet header, as the host sees it. Use read_header and write_header
+   * to convert from and to the wire. **/
+  struct Header {
+    u8 version = VERSION;
+    u8 signature = static_cast<u8>(Packet_signature::INVALID);
+    u16 flags = 0;
+    u32 payload_size = 0;
+    u32 request_id = 0;
+  };
+
+  /** Size of the header on the wire **/
+  static constexpr u64 HEADER_SIZE = 12;
+
+  /** Packets with a larger payload are not valid, so a header can not make
+   * the receiver allocate without bound **/
+  static constexpr u32 MAX_PAYLOAD_SIZE = 16 << 20;
+
 private:
 
   /** Must have same ordering and same members as Packet_signature **/
@@ -66,16 +96,16 @@ private:
 
 private:
 
-  /** Packet header **/
-  struct Header{
-    u8 signature = static_cast<u8>(Packet_signature::INVALID);
-    u16 payload_size = 0;
-  };
+  static constexpr u64 VERSION_OFFSET = 0;
+  static constexpr u64 SIGNATURE_OFFSET = 1;
+  static constexpr u64 FLAGS_OFFSET = 2;
+  static constexpr u64 PAYLOAD_SIZE_OFFSET = 4;
+  static constexpr u64 REQUEST_ID_OFFSET = 8;
 
   /** Holds everything, both the header and the payload. **/
   Buffer<u8> m_packet;
 
-  static constexpr u64 PAYLOAD_OFFSET = sizeof(Header);
+  static constexpr u64 PAYLOAD_OFFSET = HEADER_SIZE;
 
   // ====================================================================== //
   // Lifetime Methods
@@ -92,7 +122,8 @@ public:
   /**
    *
    * @param packet_signature
-   * @param capacity Reserve memory for buffer
+   * @param capacity Reserve memory for buffer, from Buffer_pool if it fits
+   *                 in a block.
    */
   explicit Tcp_packet(Packet_signature packet_signature, u64 capacity);
 
@@ -113,6 +144,15 @@ public:
   Tcp_packet(Packet_signature packet_signature, const u8* payload,
                       u64 size);
 
+  /**
+   * Construct a packet that points into memory owned by someone else,
+   * nothing is copied.
+   * Do not hold on to the packet past the lifetime of data.
+   * @param data Start of the header.
+   * @param size Header + payload size.
+   */
+  static Tcp_packet make_view(u8* data, u64 size);
+
   // ====================================================================== //
   // Getters and Setters
   // ====================================================================== //
@@ -124,7 +164,7 @@ public:
    * Do not hold on to the sub-buffer as it might be invalid past the scope.
    * @return Buffer with the payload.
    */
-  Buffer<u8>&& get_payload();
+  Buffer<u8> get_payload();
 
   /**
    * @return Copy of the payload represented as a string
@@ -157,7 +197,36 @@ public:
   u64 get_packet_size() const;
 
   /** Return size of payload. Use get_total_size to see how much memory is used. **/
-  u16 get_payload_size() const;
+  u32 get_payload_size() const;
+
+  /** Flags, stored in header **/
+  u16 get_flags() const;
+
+  void set_flags(u16 flags);
+
+  /** Request id, stored in header **/
+  u32 get_request_id() const;
+
+  void set_request_id(u32 request_id);
+
+  /**
+   * Size of the packet at the front of a stream of received bytes.
+   * @return Header + payload size, or 0 if not even the header is received.
+   */
+  static u64 peek_packet_size(const u8* data, u64 size);
+
+  /**
+   * Check the header at the front of a stream of received bytes, before the
+   * payload has been received.
+   * @return False if the header is not received yet or is not valid.
+   */
+  static bool peek_valid_header(const u8* data, u64 size);
+
+  /**
+   * Check that the signature is valid and that the payload size agrees with
+   * the size of the packet.
+   */
+  bool valid_header() const;
 
   /**
    * Convert a raw u8 data stream into a tcp_packet.
@@ -169,10 +238,22 @@ public:
 
   Buffer<u8>& get_buffer();
 
-  Header get_header();
+  Header get_header() const;
 
   void set_header(const Header& new_header);
 
+  /**
+   * Decode a header from the wire.
+   * @pre data holds at least HEADER_SIZE bytes.
+   */
+  static Header read_header(const u8* data);
+
+  /**
+   * Encode a header for the wire.
+   * @pre data has room for HEADER_SIZE bytes.
+   */
+  static void write_header(const Header& header, u8* data);
+
   // ====================================================================== //
   // Private Methods
   // ====================================================================== //
@@ -181,26 +262,21 @@ private:
 
   /**
    * Copy payload into new buffer
-   * @pre payload size must be less than maximum header size value. (2^16)
+   * @pre payload size must be at most MAX_PAYLOAD_SIZE.
    * @param payload
    * @param size
    */
   void write_payload_and_update_size(const Buffer<u8>& payload);
   void write_payload_and_update_size(const u8* payload, u64 size);
 
-  /**
-   * Get maximum possible size of the packet (header + paylaod).
-   *
-   * @bugs: It might be possible to cause overflow is header is maximum u64 size.
-   **/
-  u64 get_total_max_size();
+  /** Get maximum possible size of the packet (header + paylaod). **/
+  static u64 get_total_max_size();
 
   /**
-   * @pre payload_size must be smaller than get_total_max_size() - HEADER_SIZE.
-   *      and larger than HEADER_SIZE
+   * @pre payload_size must be at most MAX_PAYLOAD_SIZE.
    * @param payload_size
    */
-  void set_payload_size(u16 payload_size);
+  void set_payload_size(u32 payload_size);
 
   /**
    * Check if the packet signature is among the valid packet signatures.
@@ -208,9 +284,7 @@ private:
    * @param packet_signature The signature to check.
    * @return Valid or not.
    */
-  bool valid_signature(Packet_signature packet_signature);
-
-  bool valid_header();
+  static bool valid_signature(Packet_signature packet_signature);
 
   /**
    * Write 0's to header section.
@@ -34,6 +34,7 @@ namespace lightctrl {
     ssize_t read_bytes;
     auto res = chif_net_read(m_socket, buffer, size, &read_bytes);
 
+    if (res == CHIF_RESULT_WOULD_BLOCK) return 0;
     if (res != CHIF_RESULT_SUCCESS) {
       if (res == CHIF_RESULT_CONNECTION_CLOSED)
         throw socket_exception("failed to read socket, connection closed");
@@ -57,6 +58,7 @@ namespace lightctrl {
     ssize_t sent_bytes;
     auto res = chif_net_write(m_socket, buffer, size, &sent_bytes);
 
+    if (res == CHIF_RESULT_WOULD_BLOCK) return 0;
     if (res != CHIF_RESULT_SUCCESS) {
       throw socket_exception("failed to write to socket");
     }
@@ -67,12 +69,21 @@ namespace lightctrl {
   // ============================================================ //
 
   ssize_t Tcp_socket::write(const Buffer<u8> &buffer) {
-    const auto wrote = write(buffer.raw(), static_cast<size_t>(buffer.size()));
-    if ((wrote < 0 ? static_cast<u64>(0) : static_cast<u64>(wrote)) != buffer.size()) {
-      //TODO this...
-      throw std::runtime_error("Did not write all data. TODO handle that");
+    return write(buffer.raw(), static_cast<size_t>(buffer.size()));
+  }
+
+  // ============================================================ //
+
+  ssize_t Tcp_socket::write(const chif_net_slice* slices, u32 count) {
+    ssize_t sent_bytes;
+    auto res = chif_net_write_gather(m_socket, slices, count, &sent_bytes);
+
+    if (res == CHIF_RESULT_WOULD_BLOCK) return 0;
+    if (res != CHIF_RESULT_SUCCESS) {
+      throw socket_exception("failed to write to socket");
     }
-    return wrote;
+
+    return sent_bytes;
   }
 
   // ============================================================ //
@@ -115,8 +126,8 @@ namespace lightctrl {
 
   // ============================================================ //
 
-  void Tcp_socket::listen() {
-    const auto res = chif_net_listen(m_socket, CHIF_DEFAULT_MAXIMUM_BACKLOG);
+  void Tcp_socket::listen(u32 backlog) {
+    const auto res = chif_net_listen(m_socket, backlog);
 
     if (res != CHIF_RESULT_SUCCESS) {
       throw socket_exception("failed to listen");
@@ -141,6 +152,23 @@ namespace lightctrl {
 
   // ============================================================ //
 
+  bool Tcp_socket::try_accept(Tcp_socket& client) {
+    chif_net_address client_address{};
+    chif_socket socket = CHIF_INVALID_SOCKET;
+
+    const auto res = chif_net_accept_nonblocking(m_socket, &client_address, &socket);
+
+    if (res == CHIF_RESULT_WOULD_BLOCK) return false;
+    if (res != CHIF_RESULT_SUCCESS)
+      throw socket_exception("failed to accept");
+
+    client.close();
+    client.set_socket(socket);
+    return true;
+  }
+
+  // ============================================================ //
+
   bool Tcp_socket::can_read() {
     chif_bool socket_can_read;
     auto res = chif_net_can_read(m_socket, &socket_can_read);
@@ -196,6 +224,29 @@ namespace lightctrl {
     chif_net_set_reuse_addr(m_socket, static_cast<chif_bool>(reuse));
   }
 
+  void Tcp_socket::set_blocking(bool blocking) {
+    const auto res = chif_net_set_socket_blocking(m_socket, static_cast<chif_bool>(blocking));
+
+    if (res != CHIF_RESULT_SUCCESS) {
+      throw socket_exception("failed to set blocking mode");
+    }
+  }
+
+  // ============================================================ //
+
+  void Tcp_socket::set_reuse_port(bool reuse) {
+#if defined(CHIF_BERKLEY_SOCKET)
+    const auto res = chif_net_set_reuse_port(m_socket, static_cast<chif_bool>(reuse));
+
+    if (res != CHIF_RESULT_SUCCESS) {
+      throw socket_exception("failed to set reuse port");
+    }
+#else
+    (void)reuse;
+    throw socket_exception("reuse port is not supported on this platform");
+#endif
+  }
+
   void Tcp_socket::win_init() {
     if (chif_net_startup() == CHIF_FALSE)
       throw socket_exception("failed to init winsock");
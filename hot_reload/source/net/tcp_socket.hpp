@@ -22,6 +22,7 @@
 #include "../core/buffer.hpp"
 #include <string>
 #include <stdexcept>
+#include <utility>
 
 // post WINSOCK2 inclusion
 #if defined(LIGHTCTRL_PLATFORM_WINDOWS)
@@ -90,7 +91,8 @@ namespace lightctrl {
 
     // move assignment
     Tcp_socket &operator=(Tcp_socket &&other) noexcept {
-      m_socket = other.m_socket;
+      // other closes our old socket when it is destroyed
+      std::swap(m_socket, other.m_socket);
       return *this;
     };
 
@@ -120,7 +122,8 @@ namespace lightctrl {
     /**
      * Read from the socket
      * Will throw on failure.
-     * @return bytes read
+     * @return bytes read, 0 if the socket is non-blocking and nothing is
+     *         waiting.
      */
     ssize_t read(u8* buffer, size_t size);
 
@@ -137,7 +140,8 @@ namespace lightctrl {
      * Will throw on failure.
      * @param buffer
      * @param size
-     * @return bytes written
+     * @return bytes written, may be less than size when the send buffer is
+     *         full. 0 if the socket is non-blocking and no room is left.
      */
     ssize_t write(const uint8_t *buffer, size_t size);
 
@@ -145,10 +149,18 @@ namespace lightctrl {
      * Write to the socket.
      * Will throw on failure.
      * @param buffer
-     * @return bytes written
+     * @return bytes written, see write above. The caller keeps what is left.
      */
     ssize_t write(const Buffer<u8> &buffer);
 
+    /**
+     * Write several buffers in one call, in order, without copying them
+     * together first. At most CHIF_MAX_SLICES slices are written.
+     * Will throw on failure.
+     * @return bytes written over all slices, see write above.
+     */
+    ssize_t write(const chif_net_slice* slices, u32 count);
+
     /**
      * Attempt to establish a connection to the remote host.
      * Will throw on failure.
@@ -165,8 +177,9 @@ namespace lightctrl {
     /**
      * Set the socket state to LISTENING and make it ready to accept connections.
      * Will throw on failure.
+     * @param backlog Connections the kernel queues for us until accepted.
      */
-    void listen();
+    void listen(u32 backlog = CHIF_DEFAULT_MAXIMUM_BACKLOG);
 
     /**
      * Create a new socket for any connection waiting to connect.
@@ -182,6 +195,15 @@ namespace lightctrl {
      */
     Tcp_socket accept();
 
+    /**
+     * Accept a waiting connection without blocking, the listening socket
+     * must be non-blocking. The new socket is non-blocking and close-on-exec.
+     * Will throw on failure.
+     * @param client Receives the connected socket.
+     * @return False if no connection was waiting.
+     */
+    bool try_accept(Tcp_socket& client);
+
     /**
      * Will throw on failure.
      * @retval true There is data waiting to be read.
@@ -217,10 +239,29 @@ namespace lightctrl {
      * Do we have a valid socket? Note; to check for errors, use has_error
      * @return yes / no
      */
-    bool is_valid() { return m_socket != INVALID_SOCKET; };
+    bool is_valid() { return m_socket != CHIF_INVALID_SOCKET; };
+
+    /**
+     * The underlying socket, used to register it with a Poller.
+     */
+    chif_socket get_socket() const { return m_socket; };
 
     void set_reuse_addr(bool reuse);
 
+    /**
+     * A non-blocking socket returns instead of waiting when a read or write
+     * can not be done right away.
+     * Will throw on failure.
+     */
+    void set_blocking(bool blocking);
+
+    /**
+     * Allow several sockets to bind the same port, incoming connections are
+     * then load balanced between them by the kernel. Call before bind.
+     * Will throw on failure, or if not supported on the platform.
+     */
+    void set_reuse_port(bool reuse);
+
     static void win_init();
 
     static void win_shutdown() { chif_net_shutdown(); };
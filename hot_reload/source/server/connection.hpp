@@ -0,0 +1,70 @@
+#ifndef LIGHTCTRL_BACKEND_CONNECTION_HPP
+#define LIGHTCTRL_BACKEND_CONNECTION_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../net/tcp_socket.hpp"
+#include "../net/packet_decoder.hpp"
+#include "../net/send_queue.hpp"
+#include "../net/poller.hpp"
+#include "../net/payload.hpp"
+#include "../core/slab.hpp"
+#include "../core/timer_wheel.hpp"
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * A client connected to the Server, and the state kept between reads.
+   */
+  struct Connection {
+
+    using handle = Slab<Connection>::handle;
+
+    Tcp_socket socket;
+
+    /** Our handle in the server's connection table, also our poller key **/
+    handle self = Slab<Connection>::INVALID_HANDLE;
+
+    /** Packets received but not yet handled **/
+    Packet_decoder decoder;
+
+    /** Responses the socket did not take yet **/
+    Send_queue send_queue;
+
+    /** Encoding of requests and responses, set by a HANDSHAKE **/
+    Payload_encoding encoding = Payload_encoding::TEXT;
+
+    /** What the poller is watching for, reads are paused when the send
+     * queue grows past the server's high-water mark **/
+    Poller::interest interest = Poller::INTEREST_READ;
+
+    /** Requests of ours wait for room in the executor queue, reads are
+     * paused until they are submitted **/
+    bool waiting_for_executor = false;
+
+    /** Closes the connection when nothing has been read for a while **/
+    Timer_wheel::Timer idle_timer;
+
+    /** Closes the connection when queued responses are not taken in time **/
+    Timer_wheel::Timer send_timer;
+
+    /** Requests received on this connection **/
+    u64 requests = 0;
+
+    /** Response bytes handed to the socket **/
+    u64 bytes_sent = 0;
+
+    explicit Connection(Tcp_socket&& socket)
+      : socket(std::move(socket)) {}
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_CONNECTION_HPP
@@ -0,0 +1,83 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "executor.hpp"
+#include "server.hpp"
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  Executor::Executor(Plugin_host& plugin, u32 threads, u64 queue_capacity)
+    : m_plugin(plugin), m_queue(queue_capacity) {
+    if (threads == 0) threads = 1;
+
+    m_threads.reserve(threads);
+    for (u32 i = 0; i < threads; i++) {
+      m_threads.emplace_back(&Executor::run_thread, this);
+    }
+  }
+
+  // ============================================================ //
+
+  Executor::~Executor() {
+    m_queue.close();
+    for (auto& thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  // ============================================================ //
+
+  u64 Executor::submit(Request* requests, u64 count) {
+    return m_queue.try_push_many(requests, count);
+  }
+
+  // ============================================================ //
+
+  void Executor::run_thread() {
+    std::vector<Request> batch(Host_data::MAX_BATCH);
+    std::vector<int> a(Host_data::MAX_BATCH);
+    std::vector<int> b(Host_data::MAX_BATCH);
+    std::vector<int> results(Host_data::MAX_BATCH);
+    std::vector<Response> responses;
+    responses.reserve(Host_data::MAX_BATCH);
+
+    u64 count;
+    while ((count = m_queue.pop_many(batch.begin(), Host_data::MAX_BATCH)) > 0) {
+      batch.resize(count);
+      for (u64 i = 0; i < count; i++) {
+        a[i] = batch[i].a;
+        b[i] = batch[i].b;
+      }
+
+      // results holds the previous batch's answers if the plugin crashed
+      const bool failed = !m_plugin.add(a.data(), b.data(), results.data(), count);
+
+      responses.clear();
+      for (u64 i = 0; i < count; i++) {
+        responses.push_back(Response{batch[i].connection, batch[i].request_id,
+                                      batch[i].encoding, failed ? 0 : results[i], failed});
+      }
+      complete(batch, responses);
+      batch.resize(Host_data::MAX_BATCH);
+    }
+  }
+
+  // ============================================================ //
+
+  void Executor::complete(const std::vector<Request>& requests,
+                          std::vector<Response>& responses) {
+    u64 first = 0;
+    for (u64 i = 1; i <= requests.size(); i++) {
+      if (i == requests.size() || requests[i].origin != requests[first].origin) {
+        requests[first].origin->complete(&responses[first], i - first);
+        first = i;
+      }
+    }
+  }
+
+}
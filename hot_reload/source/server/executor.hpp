@@ -0,0 +1,126 @@
+#ifndef LIGHTCTRL_BACKEND_EXECUTOR_HPP
+#define LIGHTCTRL_BACKEND_EXECUTOR_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../core/types.hpp"
+#include "../core/bounded_queue.hpp"
+#include "../net/payload.hpp"
+#include "plugin_host.hpp"
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Data types
+// ============================================================ //
+
+namespace lightctrl {
+
+  class Server;
+
+  /** A decoded request, waiting to be run by the plugin **/
+  struct Request {
+    /** Where the response should be delivered **/
+    Server* origin;
+    /** Which of the origin's connections asked **/
+    u64 connection;
+    /** Chosen by the client, responses may be sent in any order **/
+    u32 request_id;
+    /** The request was sent in it, so the response is sent in it too, even
+     * if a HANDSHAKE changes the connection's encoding meanwhile **/
+    Payload_encoding encoding;
+    int a;
+    int b;
+  };
+
+  /** Result of a request, delivered back to its origin **/
+  struct Response {
+    u64 connection;
+    u32 request_id;
+    Payload_encoding encoding;
+    int result;
+    /** The plugin crashed on the request, it is answered with an empty payload **/
+    bool failed;
+  };
+
+}
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Runs requests on the plugin, away from the network threads.
+   *
+   * Servers submit decoded requests to a bounded queue, executor threads pop
+   * them, run the plugin and hand the response back to the origin server
+   * with Server::complete. A slow plugin step, or a reload, only delays the
+   * requests waiting on it and not the network io of other clients.
+   *
+   * Everything waiting in the queue is run as one batch, so the cost of a
+   * plugin step (reload check, crash guard) is shared between the requests.
+   */
+  class Executor {
+
+  public:
+
+    /**
+     * Start the executor threads.
+     * @param threads Threads running requests. A plugin with a Plugin_api is
+     *                called from all of them at once, one that is stepped
+     *                through cr_main runs on one thread at a time.
+     * @param queue_capacity Maximum number of requests waiting to run, when
+     *                       full submit takes no more.
+     */
+    explicit Executor(Plugin_host& plugin, u32 threads = 1,
+                      u64 queue_capacity = DEFAULT_QUEUE_CAPACITY);
+
+    /**
+     * Run the requests that are already queued, then stop the threads.
+     */
+    ~Executor();
+
+    Executor(const Executor& other) = delete;
+
+    Executor& operator=(const Executor& other) = delete;
+
+    /**
+     * Queue as many of the requests as there is room for, never blocks so
+     * a full queue does not stall the caller's I/O. Thread-safe.
+     * @return Number of requests queued, from the front. Less than count
+     *         when the queue is full or the executor is shutting down.
+     */
+    u64 submit(Request* requests, u64 count);
+
+    Plugin_host& plugin() { return m_plugin; }
+
+  private:
+
+    void run_thread();
+
+    /**
+     * Hand back the responses, one call to Server::complete per run of
+     * requests from the same origin.
+     */
+    static void complete(const std::vector<Request>& requests,
+                         std::vector<Response>& responses);
+
+  public:
+
+    static constexpr u64 DEFAULT_QUEUE_CAPACITY = 4096;
+
+  private:
+
+    Plugin_host& m_plugin;
+    Bounded_queue<Request> m_queue;
+    std::vector<std::thread> m_threads;
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_EXECUTOR_HPP
@@ -0,0 +1,173 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+// cr's implementation is compiled in this translation unit only
+#define CR_HOST CR_UNSAFE
+#include "plugin_host.hpp"
+#include "../core/console.hpp"
+#include "../core/logger.hpp"
+#include <algorithm>
+#include <cstring>
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  Plugin_host::Plugin_host(const char* path) {
+    m_ctx.userdata = &m_ctx_data;
+    cr_plugin_load(m_ctx, path);
+    // new versions are loaded in the background, a reload only pauses the
+    // plugin for the swap and the state transfer
+    cr_plugin_preload(m_ctx, true);
+    publish_stats();
+  }
+
+  // ============================================================ //
+
+  Plugin_host::~Plugin_host() {
+    cr_plugin_close(m_ctx);
+  }
+
+  // ============================================================ //
+
+  bool Plugin_host::add(const int* a, const int* b, int* result, u64 count) {
+    // the version we find stays loaded until we leave, even if another
+    // thread reloads the plugin meanwhile
+    cr_plugin_enter(m_ctx);
+    const Plugin_api* api = m_api.load(std::memory_order_acquire);
+    if (api != nullptr && !cr_plugin_sync_needed(m_ctx)) {
+      const bool answered = cr_plugin_call(m_ctx, [&] { api->add_batch(a, b, result, count); }) == 0;
+      cr_plugin_leave(m_ctx);
+      if (answered) return true;
+      // the results were not written, run the batch again after the rollback
+    }
+    else {
+      cr_plugin_leave(m_ctx);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (u32 attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+      if (sync_and_add(a, b, result, count)) return true;
+    }
+    Console::println(Logger::level::warn,
+                     "plugin: crashed {} times on a batch of {} requests, failing them",
+                     MAX_ATTEMPTS, count);
+    return false;
+  }
+
+  // ============================================================ //
+
+  bool Plugin_host::sync_and_add(const int* a, const int* b, int* result, u64 count) {
+    // threads coming in while a version may be swapped out wait for us
+    const Plugin_api* api = m_api.exchange(nullptr);
+    // a version that is loaded sets it again, one rolled back to may not
+    m_ctx_data.api = nullptr;
+    unsigned version = m_ctx.version;
+    cr_plugin_sync(m_ctx);
+    publish_stats();
+    if (m_ctx.version != version) {
+      log_reload();
+      api = take_api();
+      version = m_ctx.version;
+    }
+
+    bool answered;
+    if (api != nullptr && m_ctx.failure == CR_NONE) {
+      // no reload while we hold the mutex, a crash is rolled back by the
+      // next sync
+      answered = cr_plugin_call(m_ctx, [&] { api->add_batch(a, b, result, count); }) == 0;
+    }
+    else {
+      answered = step(a, b, result, count);
+      if (m_ctx.version != version) api = take_api();
+    }
+    m_api.store(api);
+    return answered;
+  }
+
+  // ============================================================ //
+
+  bool Plugin_host::step(const int* a, const int* b, int* result, u64 count) {
+    while (count > 0) {
+      const int batch = static_cast<int>(std::min<u64>(count, Host_data::MAX_BATCH));
+      const size_t bytes = batch * sizeof(int);
+
+      // load the numbers into shared memory
+      m_ctx_data.count = batch;
+      std::memcpy(m_ctx_data.a, a, bytes);
+      std::memcpy(m_ctx_data.b, b, bytes);
+
+      // execute dll
+      const unsigned version = m_ctx.version;
+      const int stepped = cr_plugin_update(m_ctx);
+      publish_stats();
+      if (m_ctx.version != version) log_reload();
+      // the results are the ones of the last batch that did not crash
+      if (stepped < 0) return false;
+
+      std::memcpy(result, m_ctx_data.result, bytes);
+      a += batch;
+      b += batch;
+      result += batch;
+      count -= batch;
+    }
+    return true;
+  }
+
+  // ============================================================ //
+
+  u32 Plugin_host::failed_loads() {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_failed_loads;
+  }
+
+  // ============================================================ //
+
+  cr_reload_stats Plugin_host::last_reload() {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_last_reload;
+  }
+
+  // ============================================================ //
+
+  void Plugin_host::publish_stats() {
+    const cr_reload_stats stats = cr_plugin_reload_stats(m_ctx);
+    const u32 failed_loads = cr_plugin_load_failures(m_ctx);
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_last_reload = stats;
+    m_failed_loads = failed_loads;
+  }
+
+  // ============================================================ //
+
+  const Plugin_api* Plugin_host::take_api() {
+    const Plugin_api* api = m_ctx_data.api;
+    if (api != nullptr && api->abi_version != Plugin_api::ABI_VERSION) {
+      Console::println(Logger::level::warn,
+                       "plugin: ABI version {}, expected {}, stepping it instead",
+                       api->abi_version, Plugin_api::ABI_VERSION);
+      return nullptr;
+    }
+    return api;
+  }
+
+  // ============================================================ //
+
+  void Plugin_host::log_reload() {
+    const cr_reload_stats stats = cr_plugin_reload_stats(m_ctx);
+    Console::println(Logger::level::info,
+                     "plugin: {} version {}, paused {} us, {} us after the change",
+                     stats.rollback ? "rolled back to" : "loaded", stats.version,
+                     stats.pause_us, stats.wait_us);
+    Console::println(Logger::level::info,
+                     "plugin: detect {} copy {} open {} symbol {} validate {} "
+                     "unload {} store {} restore {} load {} (us)",
+                     stats.detect_us, stats.copy_us, stats.open_us, stats.symbol_us,
+                     stats.validate_us, stats.unload_us, stats.store_us,
+                     stats.restore_us, stats.load_us);
+  }
+
+}
@@ -0,0 +1,149 @@
+#ifndef LIGHTCTRL_BACKEND_PLUGIN_HOST_HPP
+#define LIGHTCTRL_BACKEND_PLUGIN_HOST_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "../core/types.hpp"
+#include "../thirdparty/cr/cr.h"
+#include <atomic>
+#include <mutex>
+
+// ============================================================ //
+// Data types
+// ============================================================ //
+
+/**
+ * Entry points the plugin hands over on CR_LOAD, must match quick_maths.
+ * Called directly instead of stepping the plugin through cr_main. A plugin
+ * built against another ABI_VERSION is stepped instead.
+ */
+struct Plugin_api {
+  static constexpr u32 ABI_VERSION = 1;
+  u32 abi_version = 0;
+  int (*add)(int a, int b) = nullptr;
+  /** result[i] = a[i] + b[i] **/
+  void (*add_batch)(const int* a, const int* b, int* result, u64 count) = nullptr;
+};
+
+/**
+ * Shared with the plugin through cr_plugin::userdata, must match quick_maths.
+ * The plugin answers count requests per step, result[i] = a[i] + b[i].
+ */
+struct Host_data {
+  static constexpr int MAX_BATCH = 256;
+  int count = 0;
+  int a[MAX_BATCH] = {};
+  int b[MAX_BATCH] = {};
+  int result[MAX_BATCH] = {};
+  /** Set by the plugin on CR_LOAD, taken by the host after a reload **/
+  const Plugin_api* api = nullptr;
+};
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Owns the hot reloaded quick_maths plugin.
+   *
+   * Calls through the plugin's Plugin_api run concurrently, each thread has
+   * its own crash guard. Reloads, rollbacks and stepping the plugin through
+   * cr_main run one at a time, without waiting for those calls: a version
+   * that is replaced stays loaded until the threads still running it are
+   * done, see cr_plugin_enter. Shared by all servers in the process.
+   */
+  class Plugin_host {
+
+  public:
+
+    explicit Plugin_host(const char* path);
+
+    ~Plugin_host();
+
+    Plugin_host(const Plugin_host& other) = delete;
+
+    Plugin_host& operator=(const Plugin_host& other) = delete;
+
+    /**
+     * Answer count requests. Reloads the plugin first if it has changed.
+     * Calls the plugin's Plugin_api when it has one, otherwise steps it once
+     * per Host_data::MAX_BATCH requests. If the plugin crashes it is rolled
+     * back and the requests are run again, up to MAX_ATTEMPTS times.
+     * Thread-safe.
+     * @return False if the plugin crashed on every attempt, result is then
+     *         not valid.
+     */
+    bool add(const int* a, const int* b, int* result, u64 count);
+
+    /**
+     * Number of times loading a new version of the plugin has failed, the
+     * previous version keeps answering meanwhile.
+     * Thread-safe, does not wait for a running reload or step.
+     */
+    u32 failed_loads();
+
+    /**
+     * How long each phase of the last reload took, version is 0 until the
+     * plugin has been loaded.
+     * Thread-safe, does not wait for a running reload or step.
+     */
+    cr_reload_stats last_reload();
+
+  public:
+
+    /** Times a batch is run before its requests are failed **/
+    static constexpr u32 MAX_ATTEMPTS = 2;
+
+  private:
+
+    /**
+     * Sync the plugin, which rolls back a crash, then answer the requests.
+     * Called with m_mutex held.
+     * @return False if the plugin crashed on them.
+     */
+    bool sync_and_add(const int* a, const int* b, int* result, u64 count);
+
+    /** Log the timing of a reload that just happened **/
+    void log_reload();
+
+    /** Copy the reload stats and failed loads for failed_loads and last_reload **/
+    void publish_stats();
+
+    /** The entry points of a version that was just loaded, if usable **/
+    const Plugin_api* take_api();
+
+    /**
+     * Answer the requests through cr_main, for plugins without entry points.
+     * @return False if a step crashed or failed.
+     */
+    bool step(const int* a, const int* b, int* result, u64 count);
+
+  private:
+
+    /** Held for everything but calls through m_api **/
+    std::mutex m_mutex;
+    cr_plugin m_ctx;
+    Host_data m_ctx_data{};
+    /**
+     * The running version's entry points, nullptr to step it instead or
+     * while a reload may be going on.
+     */
+    std::atomic<const Plugin_api*> m_api{nullptr};
+
+    /**
+     * Guards the copies below, which are read without taking m_mutex so that
+     * a status report does not wait for the plugin.
+     */
+    std::mutex m_stats_mutex;
+    cr_reload_stats m_last_reload{};
+    u32 m_failed_loads = 0;
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_PLUGIN_HOST_HPP
@@ -4,6 +4,7 @@
 
 #include "server.hpp"
 #include <exception>
+#include <string>
 
 // ============================================================ //
 // Class Implementation
@@ -11,111 +12,418 @@
 
 namespace lightctrl {
 
-  Server::Server(uint16_t port) : m_port(port) {
+  Server::Server(uint16_t port, Executor& executor, bool reuse_port, u32 backlog)
+    : m_port(port), m_executor(executor) {
     m_socket.open();
     m_socket.set_reuse_addr(true);
+    if (reuse_port) {
+      m_socket.set_reuse_port(true);
+    }
     m_socket.bind(m_port);
-    m_socket.listen();
+    m_socket.listen(backlog);
+    m_socket.set_blocking(false);
+    m_poller.add(m_socket.get_socket(), LISTENER_KEY, Poller::INTEREST_READ);
+    m_timers.arm(m_status_timer, LISTENER_KEY, m_now_ms, STATUS_INTERVAL_MS);
 
     Console::println(Logger::level::info,
                      "Server up and listening on port {}.", port);
-
-    m_ctx.userdata = &m_ctx_data;
-    cr_plugin_load(m_ctx, quick_maths_dll_path);
   }
 
   // ============================================================ //
 
   Server::~Server() {
-    cr_plugin_close(m_ctx);
+    // the executor holds a pointer to us until every request is completed
+    std::unique_lock<std::mutex> lock(m_completed_mutex);
+    m_all_completed.wait(lock, [this] { return m_in_flight == 0; });
+  }
+
+  // ============================================================ //
+
+  void Server::run(s32 timeout_ms) {
+    // wake up in time for the next timer
+    const s32 timer_timeout_ms = m_timers.next_timeout_ms(Timer_wheel::now_ms());
+    if (timer_timeout_ms != Timer_wheel::NO_TIMEOUT &&
+        (timeout_ms == Poller::WAIT_FOREVER || timer_timeout_ms < timeout_ms)) {
+      timeout_ms = timer_timeout_ms;
+    }
+    // requests left over from a full executor queue are tried again soon
+    if (!m_requests.empty() &&
+        (timeout_ms == Poller::WAIT_FOREVER || SUBMIT_RETRY_MS < timeout_ms)) {
+      timeout_ms = SUBMIT_RETRY_MS;
+    }
+
+    const auto& events = m_poller.wait(timeout_ms);
+    m_now_ms = Timer_wheel::now_ms();
+
+    for (const auto& event : events) {
+      if (event.key == LISTENER_KEY) {
+        accept_connections();
+        continue;
+      }
+
+      Connection* client = m_clients.get(event.key);
+      if (client == nullptr) continue;
+
+      const u64 allocations = Allocation_counter::thread_count();
+      if (event.readable || event.error) {
+        read(*client);
+      }
+      if (event.writable && client->socket.is_valid()) {
+        flush(*client);
+      }
+      m_request_allocations.fetch_add(Allocation_counter::thread_count() - allocations, std::memory_order_relaxed);
+    }
+
+    run_timers();
+
+    const u64 allocations = Allocation_counter::thread_count();
+    submit_requests();
+    send_responses();
+    m_request_allocations.fetch_add(Allocation_counter::thread_count() - allocations, std::memory_order_relaxed);
+
+    if (!m_closed_clients.empty())
+      purge_clients();
+  }
+
+  // ============================================================ //
+
+  void Server::read(Connection& client) {
+    try {
+      client.decoder.receive(client.socket);
+      m_timers.arm(client.idle_timer, client.self, m_now_ms, IDLE_TIMEOUT_MS);
+
+      // handle every complete packet, a client may send several at once
+      Tcp_packet packet;
+      while (client.decoder.next(packet)) {
+        handle_packet(client, packet);
+      }
+    }
+    catch (socket_exception&) {
+      close_client(client);
+    }
+    catch (std::runtime_error& e) {
+      Console::println(Logger::level::warn, "server: dropping client, {}", e.what());
+      close_client(client);
+    }
+  }
+
+  // ============================================================ //
+
+  void Server::handle_packet(Connection& client, Tcp_packet& packet) {
+    // text is for debugging, show what is read
+    if (client.encoding == Payload_encoding::TEXT) {
+      Console::println(Logger::level::warn, "server: read: {} | len: {}, sig: {}",
+        packet.get_payload_as_string(),
+        packet.get_buffer().size(),
+        packet.get_signature_as_string()
+      );
+    }
+
+    const Tcp_packet::Packet_signature signature = packet.get_signature();
+    if (signature == Tcp_packet::Packet_signature::HANDSHAKE) {
+      handle_handshake(client, packet);
+      return;
+    }
+    if (signature != Tcp_packet::Packet_signature::REQUEST) return;
+
+    const Buffer<u8> payload = packet.get_payload();
+    int a;
+    int b;
+    if (!decode_request(client.encoding, payload.raw(), payload.size(), a, b)) {
+      throw std::runtime_error("malformed request");
+    }
+
+    m_requests.push_back(Request{this, client.self, packet.get_request_id(),
+                                 client.encoding, a, b});
+    client.requests++;
+  }
+
+  // ============================================================ //
+
+  void Server::handle_handshake(Connection& client, Tcp_packet& packet) {
+    const Buffer<u8> payload = packet.get_payload();
+    client.encoding = decode_encoding(payload.raw(), payload.size());
+
+    const u8 answer = static_cast<u8>(client.encoding);
+    Tcp_packet::Header reply;
+    reply.signature = static_cast<u8>(Tcp_packet::Packet_signature::HANDSHAKE);
+    reply.request_id = packet.get_request_id();
+    if (client.send_queue.empty()) {
+      m_flushing.push_back(client.self);
+    }
+    client.send_queue.push(reply, &answer, 1);
+    Console::println("server: client uses {} payloads",
+                     get_encoding_as_string(client.encoding));
+  }
+
+  // ============================================================ //
+
+  void Server::submit_requests() {
+    if (m_requests.empty()) return;
+
+    const u64 count = m_requests.size();
+    {
+      std::lock_guard<std::mutex> lock(m_completed_mutex);
+      m_in_flight += count;
+    }
+
+    const u64 submitted = m_executor.submit(m_requests.data(), count);
+    if (submitted < count) {
+      std::lock_guard<std::mutex> lock(m_completed_mutex);
+      m_in_flight -= count - submitted;
+      if (m_in_flight == 0) m_all_completed.notify_all();
+    }
+    m_requests.erase(m_requests.begin(), m_requests.begin() + submitted);
+
+    if (!m_requests.empty()) {
+      // the queue is full, read no more from the clients that are waiting
+      for (const auto& request : m_requests) {
+        Connection* client = m_clients.get(request.connection);
+        if (client == nullptr || !client->socket.is_valid() ||
+            client->waiting_for_executor) continue;
+        client->waiting_for_executor = true;
+        m_waiting.push_back(client->self);
+        update_interest(*client);
+      }
+      return;
+    }
+
+    for (const auto handle : m_waiting) {
+      Connection* client = m_clients.get(handle);
+      if (client == nullptr || !client->socket.is_valid()) continue;
+      client->waiting_for_executor = false;
+      update_interest(*client);
+    }
+    m_waiting.clear();
+  }
+
+  // ============================================================ //
+
+  void Server::complete(Response* responses, u64 count) {
+    std::lock_guard<std::mutex> lock(m_completed_mutex);
+    m_completed.insert(m_completed.end(), responses, responses + count);
+    // woken before the count drops, the destructor may return right after
+    m_poller.wake();
+    m_in_flight -= count;
+    if (m_in_flight == 0) m_all_completed.notify_all();
   }
 
   // ============================================================ //
 
-  void Server::run() {
-    accept_connections();
-    read();
+  void Server::send_responses() {
+    {
+      std::lock_guard<std::mutex> lock(m_completed_mutex);
+      m_sending.swap(m_completed);
+    }
+    // handshakes answered during the reads are flushed too
+    if (m_sending.empty() && m_flushing.empty()) return;
+
+    for (const auto& response : m_sending) {
+      // the client may have disconnected while the request was running, a
+      // stale handle is not mistaken for a new client in the same slot
+      Connection* client = m_clients.get(response.connection);
+      if (client == nullptr || !client->socket.is_valid()) continue;
+
+      // the header and payload are written into the send queue, no packet
+      // is built per response
+      u8 payload[MAX_RESPONSE_PAYLOAD_SIZE];
+      const u64 size = response.failed ? 0 : encode_response(response.encoding, response.result, payload);
+      Tcp_packet::Header header;
+      header.signature = static_cast<u8>(Tcp_packet::Packet_signature::RESPONSE);
+      header.request_id = response.request_id;
+      if (client->send_queue.empty()) {
+        m_flushing.push_back(client->self);
+      }
+      try {
+        client->bytes_sent += client->send_queue.send(client->socket, header, payload, size);
+      }
+      catch (socket_exception&) {
+        close_client(*client);
+        continue;
+      }
+      if (response.encoding == Payload_encoding::TEXT) {
+        Console::println("server: answering {}",
+                         std::string(reinterpret_cast<const char*>(payload), size));
+      }
+    }
+    m_sending.clear();
+
+    // clients that already had responses queued are flushed when writable
+    for (const auto handle : m_flushing) {
+      Connection* client = m_clients.get(handle);
+      if (client != nullptr && client->socket.is_valid()) flush(*client);
+    }
+    m_flushing.clear();
   }
 
   // ============================================================ //
 
-  void Server::read() {
-    bool remove_closed_clients = false;
+  void Server::flush(Connection& client) {
+    try {
+      client.bytes_sent += client.send_queue.flush(client.socket);
+      update_interest(client);
 
-    for (auto& client : m_clients) {
-      if (client.can_read()) {
-        try {
-          Tcp_packet packet(Tcp_packet::Packet_signature::INVALID, 1024);
-          client.read(packet.get_buffer());
-          Console::println(Logger::level::warn, "server: read: {} | len: {}, sig: {}",
-            packet.get_payload_as_string(),
-            packet.get_buffer().size(),
-            packet.get_signature_as_string()
-          );
+      // the deadline covers the whole queue, not each write
+      if (client.send_queue.empty()) {
+        m_timers.cancel(client.send_timer);
+      }
+      else if (!client.send_timer.armed()) {
+        m_timers.arm(client.send_timer, client.self, m_now_ms, SEND_TIMEOUT_MS);
+      }
+    }
+    catch (socket_exception&) {
+      close_client(client);
+    }
+  }
 
-          // parse the two numbers
-          const std::string question = packet.get_payload_as_string();
-          const unsigned long long comma = question.find(',');
-          if (comma == std::string::npos)
-            throw std::runtime_error("failed to find comma");
-          const std::string num1 = question.substr(0, comma);
-          const std::string num2 = question.substr(comma + 1);
+  // ============================================================ //
 
-          // load the two numbers into shared memory
-          static_cast<Host_data*>(m_ctx.userdata)->a = std::stoi(num1);
-          static_cast<Host_data*>(m_ctx.userdata)->b = std::stoi(num2);
+  void Server::update_interest(Connection& client) {
+    const u64 queued = client.send_queue.size();
+    bool reading = (client.interest & Poller::INTEREST_READ) != 0;
+    if (reading && queued >= SEND_HIGH_WATER_MARK) {
+      reading = false;
+      Console::println(Logger::level::info, "server: client not reading, pausing its reads");
+    }
+    else if (!reading && queued <= SEND_LOW_WATER_MARK) {
+      reading = true;
+    }
+    if (client.waiting_for_executor) {
+      reading = false;
+    }
 
-          // execute dll
-          cr_plugin_update(m_ctx);
+    const Poller::interest interest = static_cast<Poller::interest>(
+      (reading ? Poller::INTEREST_READ : Poller::INTEREST_NONE) |
+      (queued > 0 ? Poller::INTEREST_WRITE : Poller::INTEREST_NONE));
+    if (interest != client.interest) {
+      m_poller.modify(client.socket.get_socket(), client.self, interest);
+      client.interest = interest;
+    }
+  }
 
-          // retrive result and send it away
-          packet.set_signature(Tcp_packet::Packet_signature::RESPONSE);
-          const Buffer<u8> buffer(std::to_string(static_cast<Host_data*>(m_ctx.userdata)->result));
-          packet.set_payload(buffer);
-          const ssize_t sent_bytes = client.write(packet.get_buffer());
-          Console::println("server: answering {}, sent_bytes: {}", 
-            packet.get_payload_as_string(),
-            sent_bytes
-          );
+  // ============================================================ //
+
+  void Server::run_timers() {
+    m_timers.advance(m_now_ms, [this](Timer_wheel::Timer& timer) {
+      if (&timer == &m_status_timer) {
+        Plugin_host& plugin = m_executor.plugin();
+        const cr_reload_stats reload = plugin.last_reload();
+        Console::println(Logger::level::info,
+                         "server: {} connected clients, plugin version {}, last reload paused {} us, {} failed loads",
+                         m_clients.size(), reload.version, reload.pause_us, plugin.failed_loads());
+        if (Allocation_counter::ENABLED) {
+          Console::println(Logger::level::info, "server: {} allocations on the request path",
+                           request_allocations());
         }
-        catch (socket_exception&) {
-          try {
-            client.close();
-          }
-          catch (socket_exception&) {};
-          remove_closed_clients = true;
+        m_timers.arm(m_status_timer, LISTENER_KEY, m_now_ms, STATUS_INTERVAL_MS);
+        return;
+      }
+      if (&timer == &m_accept_timer) {
+        resume_accepting();
+        return;
+      }
+
+      Connection* client = m_clients.get(timer.key());
+      if (client == nullptr || !client->socket.is_valid()) return;
+
+      if (&timer == &client->idle_timer) {
+        Console::println(Logger::level::info, "server: closing idle client");
+      }
+      else {
+        Console::println(Logger::level::info, "server: closing client, responses not taken in time");
+      }
+      close_client(*client);
+    });
+  }
+
+  // ============================================================ //
+
+  void Server::close_client(Connection& client) {
+    m_timers.cancel(client.idle_timer);
+    m_timers.cancel(client.send_timer);
+    m_poller.remove(client.socket.get_socket());
+    m_closed_clients.push_back(client.self);
+    Console::println("server: closing client after {} requests, {} bytes sent",
+                     client.requests, client.bytes_sent);
+    try {
+      client.socket.close();
+    }
+    catch (socket_exception&) {};
+  }
+
+  // ============================================================ //
+
+  void Server::accept_connections() {
+    // take the whole backlog, a burst of reconnects should not wait one
+    // wakeup per connection
+    while (true) {
+      Tcp_socket client;
+      try {
+        if (!m_socket.try_accept(client)) break;
+      }
+      catch (socket_exception& e) {
+        // e.g. out of file descriptors. The listening socket stays readable,
+        // it is left out of the poll until a client closes or a while passed
+        if (!m_accept_failing) {
+          Console::println(Logger::level::warn, "server: pausing accepts, {}", e.what());
+          m_accept_failing = true;
         }
+        m_poller.modify(m_socket.get_socket(), LISTENER_KEY, Poller::INTEREST_NONE);
+        m_accept_paused = true;
+        m_timers.arm(m_accept_timer, LISTENER_KEY, m_now_ms, ACCEPT_RETRY_MS);
+        break;
+      }
+      if (m_accept_failing) {
+        Console::println(Logger::level::info, "server: accepting again");
+        m_accept_failing = false;
       }
+      add_client(std::move(client));
     }
+  }
 
-    if (remove_closed_clients)
-      purge_clients();
+  // ============================================================ //
+
+  void Server::resume_accepting() {
+    if (!m_accept_paused) return;
+    m_timers.cancel(m_accept_timer);
+    m_poller.modify(m_socket.get_socket(), LISTENER_KEY, Poller::INTEREST_READ);
+    m_accept_paused = false;
   }
 
   // ============================================================ //
 
-  void Server::accept_connections() {
-    if (m_socket.can_accept()) {
-      Console::println("accepted connection");
-      m_clients.emplace_back(m_socket.accept());
-      std::string client_address = m_clients.back().get_address();
-      Console::println("Client connected from {}.", client_address);
+  void Server::add_client(Tcp_socket&& client) {
+    const chif_socket socket = client.get_socket();
+    const Connection::handle handle = m_clients.emplace(std::move(client));
+    Connection& connection = *m_clients.get(handle);
+    connection.self = handle;
+    m_timers.arm(connection.idle_timer, handle, m_now_ms, IDLE_TIMEOUT_MS);
+    try {
+      m_poller.add(socket, handle, Poller::INTEREST_READ);
+    }
+    catch (socket_exception& e) {
+      Console::println(Logger::level::warn, "server: dropping new client, {}", e.what());
+      m_clients.erase(handle);
+      return;
     }
+    Console::println("Client connected from {}.", connection.socket.get_address());
   }
 
   // ============================================================ //
 
   void Server::purge_clients() {
     const auto size_before = m_clients.size();
-    m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(),
-      [](auto& client) {
-      return !client.is_valid();
-    }), m_clients.end());
+    for (const auto handle : m_closed_clients) {
+      m_clients.erase(handle);
+    }
+    m_closed_clients.clear();
 
     if (size_before > m_clients.size()) {
       Console::println(Logger::level::info,
         "Client disconnected | There are {} connected devices.",
         m_clients.size());
+      // their file descriptors are free again
+      resume_accepting();
     }
   }
 
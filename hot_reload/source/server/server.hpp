@@ -10,21 +10,16 @@
 #include "../core/logger.hpp"
 #include "../net/tcp_socket.hpp"
 #include "../net/tcp_packet.hpp"
+#include "../net/poller.hpp"
 #include "../core/buffer.hpp"
+#include "../core/timer_wheel.hpp"
+#include "../core/allocation_counter.hpp"
+#include "executor.hpp"
+#include "connection.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
-#define CR_HOST CR_UNSAFE
-#include "../thirdparty/cr/cr.h"
-
-
-// ============================================================ //
-// Data types
-// ============================================================ //
-
-struct Host_data {
-  int a = 0;
-  int b = 0;
-  int result = 0;
-};
 
 // ============================================================ //
 // Class Declaration
@@ -40,37 +35,199 @@ namespace lightctrl {
      * Open a socket, bind it to port and start listening.
      *
      * On error it will exit the program with critical log message.
+     * @param executor Answers the requests, may be shared between servers.
+     * @param reuse_port Let several servers listen on the same port, the
+     *                   kernel will spread the connections between them.
+     * @param backlog Connections waiting to be accepted before the kernel
+     *                starts to refuse them.
      */
-    explicit Server(uint16_t port);
+    Server(uint16_t port, Executor& executor, bool reuse_port = false,
+           u32 backlog = DEFAULT_BACKLOG);
 
+    /**
+     * Waits for the requests still running on the executor.
+     */
     ~Server();
 
     /**
-     * Main loop
+     * Main loop. Blocks until there is traffic, or timeout has passed.
+     * @param timeout_ms Milliseconds, or Poller::WAIT_FOREVER.
      */
-    void run();
+    void run(s32 timeout_ms = Poller::WAIT_FOREVER);
 
     /**
-     * Read incoming traffic if there is any
+     * Read incoming traffic from a client that is ready to be read, and
+     * handle every complete packet received so far.
      */
-    void read();
+    void read(Connection& client);
 
     /**
-     * Accept new tcp connections if there are any.
+     * Accept every waiting tcp connection, call when the listening socket is
+     * ready.
      */
     void accept_connections();
 
+    /**
+     * Poll the listening socket again after accepting failed, call when a
+     * file descriptor may have been freed.
+     */
+    void resume_accepting();
+
+    /**
+     * Remove the clients that were closed during this run.
+     */
     void purge_clients();
 
+    /**
+     * Hand back the responses to requests, they are sent on the next run.
+     * Responses are sent in the order they complete, not in the order the
+     * requests came in, the client matches them up by request id.
+     * Thread-safe, called by the executor.
+     */
+    void complete(Response* responses, u64 count);
+
+    /**
+     * Make a run() waiting on another thread return. Thread-safe.
+     */
+    void wake() { m_poller.wake(); }
+
+    /** Number of connected clients **/
+    u64 client_count() const { return m_clients.size(); }
+
+    /**
+     * Heap allocations made while reading requests and sending responses,
+     * connecting and timers not included. Only counted when built with
+     * LIGHTCTRL_COUNT_ALLOCATIONS, see Allocation_counter. Once the buffers
+     * have warmed up it should stop growing for binary clients, the
+     * allocation check in main and the status log report it. May be read
+     * from any thread, it is only exact while the server is not running.
+     */
+    u64 request_allocations() const { return m_request_allocations.load(std::memory_order_relaxed); }
+
+  public:
+
+    /** Large enough to absorb a burst of reconnects, the kernel caps it at
+     * somaxconn **/
+    static constexpr u32 DEFAULT_BACKLOG = 1024;
+
+  private:
+
+    void add_client(Tcp_socket&& client);
+
+    /**
+     * Queue the request in a received packet, or answer a handshake.
+     * @throw std::runtime_error If a request can not be decoded.
+     */
+    void handle_packet(Connection& client, Tcp_packet& packet);
+
+    /**
+     * Switch the client to the encoding it asks for, and tell it which
+     * encoding is used from now on.
+     */
+    void handle_handshake(Connection& client, Tcp_packet& packet);
+
+    /**
+     * Submit the requests read during this run as one batch. What does not
+     * fit in the executor queue is kept for the next run, and the clients
+     * it came from stop being read until it is submitted.
+     */
+    void submit_requests();
+
+    /**
+     * Queue the responses completed since last run, and send what the
+     * sockets take.
+     */
+    void send_responses();
+
+    /**
+     * Send queued responses, call when the socket is writable.
+     */
+    void flush(Connection& client);
+
+    /**
+     * Watch for writable while responses are queued, and pause reads while
+     * the queue is above the high-water mark or requests wait for the
+     * executor.
+     */
+    void update_interest(Connection& client);
+
+    /**
+     * Handle the timers that are due, and re-arm the periodic ones.
+     */
+    void run_timers();
+
+    void close_client(Connection& client);
+
   private:
 
+    /** Poller key of the listening socket, client keys are their handles **/
+    static constexpr u64 LISTENER_KEY = ~0ULL;
+
+    /** Queued response bytes at which a client's reads are paused, so a
+     * client that does not read can not make us buffer without bound **/
+    static constexpr u64 SEND_HIGH_WATER_MARK = 1 << 20;
+
+    /** Queued response bytes at which paused reads are resumed **/
+    static constexpr u64 SEND_LOW_WATER_MARK = SEND_HIGH_WATER_MARK / 4;
+
+    static constexpr u64 TIMER_TICK_MS = 10;
+
+    /** How soon requests that did not fit in the executor queue are tried
+     * again, if no completion wakes us up first **/
+    static constexpr s32 SUBMIT_RETRY_MS = 1;
+
+    /** A client that sends nothing for this long is closed **/
+    static constexpr u64 IDLE_TIMEOUT_MS = 5 * 60 * 1000;
+
+    /** A client that does not take its queued responses within this long is
+     * closed **/
+    static constexpr u64 SEND_TIMEOUT_MS = 30 * 1000;
+
+    /** How often the number of clients is logged **/
+    static constexpr u64 STATUS_INTERVAL_MS = 60 * 1000;
+
+    /** How long the listening socket is left out of the poll after accepting
+     * failed, e.g. out of file descriptors, unless a client closes first **/
+    static constexpr u64 ACCEPT_RETRY_MS = 100;
+
     Tcp_socket m_socket{};
     uint16_t m_port;
-    std::vector<Tcp_socket> m_clients;
-
-    cr_plugin m_ctx;
-    const char* quick_maths_dll_path = "C:/Users/chris/Documents/github/hot_reload/x64/Debug/quick_maths.dll";
-    Host_data m_ctx_data{};
+    Poller m_poller{};
+    /** Declared before everything that embeds a timer, it must outlive them **/
+    Timer_wheel m_timers{TIMER_TICK_MS, Timer_wheel::now_ms()};
+    /** Time of the last wake up, saves a clock read per timer armed **/
+    u64 m_now_ms = Timer_wheel::now_ms();
+    Timer_wheel::Timer m_status_timer;
+    Timer_wheel::Timer m_accept_timer;
+    /** The listening socket is left out of the poll, see ACCEPT_RETRY_MS **/
+    bool m_accept_paused = false;
+    /** Accepting failed and has not succeeded since, the failure is logged once **/
+    bool m_accept_failing = false;
+    Slab<Connection> m_clients;
+    std::vector<Connection::handle> m_closed_clients;
+
+    Executor& m_executor;
+
+    /** Requests read during this run, or left over from an earlier run
+     * when the executor queue was full, not yet submitted **/
+    std::vector<Request> m_requests;
+
+    /** Clients whose reads are paused until m_requests is submitted **/
+    std::vector<Connection::handle> m_waiting;
+
+    /** Guards m_completed and m_in_flight **/
+    std::mutex m_completed_mutex;
+    std::condition_variable m_all_completed;
+    std::vector<Response> m_completed;
+    /** Swapped with m_completed when sending, to keep its memory around **/
+    std::vector<Response> m_sending;
+    /** Clients given responses this run that had nothing queued before **/
+    std::vector<Connection::handle> m_flushing;
+    /** Submitted requests not yet completed **/
+    u64 m_in_flight = 0;
+
+    /** Written by the thread that runs the server only **/
+    std::atomic<u64> m_request_allocations{0};
 
   };
 
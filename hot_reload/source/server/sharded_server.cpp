@@ -0,0 +1,112 @@
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "sharded_server.hpp"
+#include "../core/console.hpp"
+#include <algorithm>
+
+// ============================================================ //
+// Class Implementation
+// ============================================================ //
+
+namespace lightctrl {
+
+  Sharded_server::Sharded_server(u16 port, Executor& executor, u32 workers, u32 backlog)
+    : m_port(port), m_backlog(backlog), m_executor(executor) {
+    if (workers == 0) {
+      workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<std::promise<void>> started(workers);
+    m_servers.resize(workers, nullptr);
+    m_workers.reserve(workers);
+    for (u32 i = 0; i < workers; i++) {
+      m_workers.emplace_back(&Sharded_server::run_worker, this, i, std::ref(started[i]));
+    }
+
+    // rethrow if any worker failed to bind or listen
+    try {
+      for (auto& promise : started) {
+        promise.get_future().get();
+      }
+    }
+    catch (...) {
+      stop();
+      join();
+      throw;
+    }
+
+    Console::println(Logger::level::info,
+                     "Sharded server running {} workers on port {}.", workers, port);
+  }
+
+  // ============================================================ //
+
+  Sharded_server::~Sharded_server() {
+    stop();
+    join();
+  }
+
+  // ============================================================ //
+
+  void Sharded_server::stop() {
+    m_running = false;
+
+    // a worker that registers after this sees m_running and does not wait
+    std::lock_guard<std::mutex> lock(m_servers_mutex);
+    for (Server* server : m_servers) {
+      if (server != nullptr) server->wake();
+    }
+  }
+
+  // ============================================================ //
+
+  void Sharded_server::join() {
+    for (auto& worker : m_workers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+  }
+
+  // ============================================================ //
+
+  void Sharded_server::set_server(u32 index, Server* server) {
+    std::lock_guard<std::mutex> lock(m_servers_mutex);
+    m_servers[index] = server;
+  }
+
+  // ============================================================ //
+
+  void Sharded_server::run_worker(u32 index, std::promise<void>& started) {
+    // started is owned by the constructor, only touch it until it is set
+    bool listening = false;
+
+    try {
+      Server server(m_port, m_executor, true, m_backlog);
+
+      // registered until the server is destroyed, so stop can wake it
+      struct Registration {
+        Sharded_server& owner;
+        u32 index;
+        ~Registration() { owner.set_server(index, nullptr); }
+      } registration{*this, index};
+      set_server(index, &server);
+
+      started.set_value();
+      listening = true;
+
+      while (m_running) {
+        server.run(Poller::WAIT_FOREVER);
+      }
+    }
+    catch (std::exception& e) {
+      Console::println(Logger::level::err, "worker {} stopped: {}", index, e.what());
+      if (!listening) {
+        started.set_exception(std::current_exception());
+      }
+    }
+  }
+
+}
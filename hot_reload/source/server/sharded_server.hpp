@@ -0,0 +1,83 @@
+#ifndef LIGHTCTRL_BACKEND_SHARDED_SERVER_HPP
+#define LIGHTCTRL_BACKEND_SHARDED_SERVER_HPP
+
+// ============================================================ //
+// Headers
+// ============================================================ //
+
+#include "server.hpp"
+#include "executor.hpp"
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Class Declaration
+// ============================================================ //
+
+namespace lightctrl {
+
+  /**
+   * Runs one Server per worker thread, all listening on the same port.
+   *
+   * Every worker binds its own reuse port listener and owns its own clients,
+   * the kernel spreads incoming connections between the workers. The
+   * executor running the plugin is shared by all workers.
+   */
+  class Sharded_server {
+
+  public:
+
+    /**
+     * Start the workers, returns once all of them are listening.
+     * Will throw if any of the workers failed to start.
+     * @param workers Number of worker threads, 0 means one per core.
+     * @param backlog Listen backlog of each worker, see Server.
+     */
+    Sharded_server(u16 port, Executor& executor, u32 workers = 0,
+                   u32 backlog = Server::DEFAULT_BACKLOG);
+
+    ~Sharded_server();
+
+    Sharded_server(const Sharded_server& other) = delete;
+
+    Sharded_server& operator=(const Sharded_server& other) = delete;
+
+    /**
+     * Ask the workers to stop, they are woken up, close their clients and
+     * return.
+     */
+    void stop();
+
+    /**
+     * Block until all workers have stopped.
+     */
+    void join();
+
+  private:
+
+    void run_worker(u32 index, std::promise<void>& started);
+
+    void set_server(u32 index, Server* server);
+
+  private:
+
+    u16 m_port;
+    u32 m_backlog;
+    Executor& m_executor;
+    std::atomic<bool> m_running{true};
+    std::vector<std::thread> m_workers;
+
+    /** Guards m_servers **/
+    std::mutex m_servers_mutex;
+
+    /** The server of each worker while it runs, for stop to wake it **/
+    std::vector<Server*> m_servers;
+
+  };
+
+}
+
+#endif //LIGHTCTRL_BACKEND_SHARDED_SERVER_HPP
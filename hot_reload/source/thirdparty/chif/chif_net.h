@@ -66,6 +66,7 @@ extern "C" {
 # include <unistd.h>
 # include <fcntl.h>
 # include <sys/ioctl.h>
+# include <sys/uio.h>
 #endif
 
 // Inline
@@ -95,6 +96,12 @@ typedef int chif_socket;
 typedef timeval TIMEVAL;
 #endif
 
+// A piece of a gathered write, see chif_net_write_gather
+typedef struct chif_net_slice {
+  const uint8_t *data;
+  size_t size;
+} chif_net_slice;
+
 // ====================================================================== //
 // Macro declarations
 // ====================================================================== //
@@ -119,6 +126,9 @@ typedef timeval TIMEVAL;
 // default argument for listen
 #define CHIF_DEFAULT_MAXIMUM_BACKLOG 128
 
+// Most slices taken by one chif_net_write_gather call
+#define CHIF_MAX_SLICES 16
+
 // Minimum string length for when translating an iv4 socket struct address to string address representation.
 #define CHIF_IPV4_STRING_LENGTH INET_ADDRSTRLEN
 // Minimum string length for when translating an iv6 socket struct address to string address representation.
@@ -294,6 +304,19 @@ chif_net_result chif_net_listen(chif_socket socket, uint32_t maximum_backlog);
  */
 chif_socket chif_net_accept(chif_socket server_socket, chif_net_address *client_address);
 
+/**
+ * Accept without blocking, for use on a non-blocking listening socket. The
+ * client socket is made non-blocking and close-on-exec, on Linux in the same
+ * accept4 call.
+ * @param server_socket
+ * @param client_address
+ * @param client_socket_out Set to the client socket on success.
+ * @return CHIF_RESULT_WOULD_BLOCK when no connection is waiting.
+ */
+chif_net_result chif_net_accept_nonblocking(chif_socket server_socket,
+                                            chif_net_address *client_address,
+                                            chif_socket *client_socket_out);
+
 /**
  * Read data from the socket. Will block if blocking is set.
  * @param socket
@@ -314,6 +337,19 @@ chif_net_result chif_net_read(chif_socket socket, uint8_t *buffer, size_t size,
  */
 chif_net_result chif_net_write(chif_socket socket, const uint8_t *buffer, size_t size, ssize_t *sent_bytes);
 
+/**
+ * Write several buffers to a socket in one call, in order, as if they were
+ * one. Uses sendmsg or WSASend, the buffers are not copied together.
+ * At most CHIF_MAX_SLICES slices are written, the rest is left for the
+ * caller as with a short write.
+ * @param socket
+ * @param slices
+ * @param count
+ * @param sent_bytes
+ * @return Result of the operation.
+ */
+chif_net_result chif_net_write_gather(chif_socket socket, const chif_net_slice *slices, size_t count, ssize_t *sent_bytes);
+
 /**
  * Can we read without blocking? Is there anything to read?
  * See chif_net_get_bytes_available to get amount of bytes that can be read.
@@ -557,6 +593,19 @@ CHIF_INLINE chif_net_result chif_net_open_socket(chif_socket *socket_out, chif_n
   return CHIF_RESULT_SUCCESS;
 }
 
+/** Like _chif_get_spefic_result_type, but for read and write, where
+ * EAGAIN means the non-blocking call would block. **/
+CHIF_INLINE chif_net_result _chif_get_io_result_type() {
+#if defined(CHIF_WINSOCK2)
+  if (GetLastError() == WSAEWOULDBLOCK)
+    return CHIF_RESULT_WOULD_BLOCK;
+#elif defined(CHIF_BERKLEY_SOCKET)
+  if (errno == EAGAIN || errno == EWOULDBLOCK)
+    return CHIF_RESULT_WOULD_BLOCK;
+#endif
+  return _chif_get_spefic_result_type();
+}
+
 CHIF_INLINE chif_net_result chif_net_close_socket(chif_socket *socket) {
   if (*socket != CHIF_INVALID_SOCKET) {
     // Close the socket
@@ -615,7 +664,7 @@ CHIF_INLINE chif_socket chif_net_accept(chif_socket server_socket, chif_net_addr
   chif_socket client_socket;
   socklen_t client_addrlen = sizeof(struct sockaddr_in);
 
-  client_socket = accept(server_socket, (struct sockaddr *) &client_address, &client_addrlen);
+  client_socket = accept(server_socket, (struct sockaddr *) client_address, &client_addrlen);
 
   //TODO handle errors differently?
   if (client_socket == CHIF_INVALID_SOCKET) {
@@ -625,6 +674,38 @@ CHIF_INLINE chif_socket chif_net_accept(chif_socket server_socket, chif_net_addr
   return client_socket;
 }
 
+CHIF_INLINE chif_net_result chif_net_accept_nonblocking(chif_socket server_socket,
+                                                        chif_net_address *client_address,
+                                                        chif_socket *client_socket_out) {
+  chif_socket client_socket;
+  socklen_t client_addrlen = sizeof(struct sockaddr_in);
+
+#if defined(__linux__)
+  client_socket = accept4(server_socket, (struct sockaddr *) client_address, &client_addrlen,
+                          SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  client_socket = accept(server_socket, (struct sockaddr *) client_address, &client_addrlen);
+#endif
+
+  if (client_socket == CHIF_INVALID_SOCKET) {
+    return _chif_get_io_result_type();
+  }
+
+#if !defined(__linux__)
+  const chif_net_result result = chif_net_set_socket_blocking(client_socket, CHIF_FALSE);
+  if (result != CHIF_RESULT_SUCCESS) {
+    chif_net_close_socket(&client_socket);
+    return result;
+  }
+# if defined(CHIF_BERKLEY_SOCKET)
+  fcntl(client_socket, F_SETFD, FD_CLOEXEC);
+# endif
+#endif
+
+  *client_socket_out = client_socket;
+  return CHIF_RESULT_SUCCESS;
+}
+
 CHIF_INLINE chif_net_result chif_net_read(chif_socket socket, uint8_t *buffer, size_t size, ssize_t *read_bytes) {
   if (socket == CHIF_INVALID_SOCKET)
     return CHIF_RESULT_NOT_A_SOCKET;
@@ -638,7 +719,7 @@ CHIF_INLINE chif_net_result chif_net_read(chif_socket socket, uint8_t *buffer, s
   const ssize_t result = recv(socket, (char*)buffer, (int)size, flag);
 
   if (result == CHIF_SOCKET_ERROR)
-    return _chif_get_spefic_result_type();
+    return _chif_get_io_result_type();
   else if (!result)
     return chif_net_result::CHIF_RESULT_CONNECTION_CLOSED;
 
@@ -661,9 +742,54 @@ chif_net_write(chif_socket socket, const uint8_t *buffer, size_t size, ssize_t *
   const ssize_t result = send((int)socket, (char*)buffer, (int)size, flag);
 
   if (result == CHIF_SOCKET_ERROR)
-    return _chif_get_spefic_result_type();
+    return _chif_get_io_result_type();
+
+  *sent_bytes = result;
+
+  return CHIF_RESULT_SUCCESS;
+}
+
+CHIF_INLINE chif_net_result
+chif_net_write_gather(chif_socket socket, const chif_net_slice *slices, size_t count, ssize_t *sent_bytes) {
+  if (socket == CHIF_INVALID_SOCKET)
+    return CHIF_RESULT_NOT_A_SOCKET;
+
+  if (count > CHIF_MAX_SLICES)
+    count = CHIF_MAX_SLICES;
+
+#if defined(CHIF_WINSOCK2)
+  WSABUF buffers[CHIF_MAX_SLICES];
+  for (size_t i = 0; i < count; i++) {
+    buffers[i].buf = (CHAR*)slices[i].data;
+    buffers[i].len = (ULONG)slices[i].size;
+  }
+
+  DWORD sent = 0;
+  const int result = WSASend(socket, buffers, (DWORD)count, &sent, 0, NULL, NULL);
+
+  if (result == CHIF_SOCKET_ERROR)
+    return _chif_get_io_result_type();
+
+  *sent_bytes = (ssize_t)sent;
+#elif defined(CHIF_BERKLEY_SOCKET)
+  struct iovec buffers[CHIF_MAX_SLICES];
+  for (size_t i = 0; i < count; i++) {
+    buffers[i].iov_base = (void*)slices[i].data;
+    buffers[i].iov_len = slices[i].size;
+  }
+
+  struct msghdr message = {};
+  message.msg_iov = buffers;
+  message.msg_iovlen = count;
+
+  // Prevent SIGPIPE signal and handle the error in application code
+  const ssize_t result = sendmsg(socket, &message, MSG_NOSIGNAL);
+
+  if (result == CHIF_SOCKET_ERROR)
+    return _chif_get_io_result_type();
 
   *sent_bytes = result;
+#endif
 
   return CHIF_RESULT_SUCCESS;
 }
@@ -847,7 +973,8 @@ CHIF_INLINE chif_net_result chif_net_get_bytes_available(chif_socket socket, int
 }
 
 CHIF_INLINE chif_net_result chif_net_set_reuse_addr(chif_socket socket, chif_bool reuse) {
-  const ssize_t result = setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(int));
+  const int value = reuse;
+  const ssize_t result = setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, (char*)&value, sizeof(int));
 
   if (result < 0) {
     return _chif_get_spefic_result_type();
@@ -858,7 +985,8 @@ CHIF_INLINE chif_net_result chif_net_set_reuse_addr(chif_socket socket, chif_boo
 
 #if defined(CHIF_BERKLEY_SOCKET)
 CHIF_INLINE chif_net_result chif_net_set_reuse_port(chif_socket socket, chif_bool reuse) {
-  const ssize_t result = setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(int));
+  const int value = reuse;
+  const ssize_t result = setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, (char*)&value, sizeof(int));
 
   if (result < 0) {
     return _chif_get_spefic_result_type();
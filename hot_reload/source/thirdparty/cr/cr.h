@@ -322,6 +322,26 @@ struct cr_plugin {
   enum cr_failure failure;
 };
 
+// Time spent in each phase of a reload, in microseconds, see
+// cr_plugin_reload_stats. When preloading, the copy, open, symbol lookup and
+// most of the validation run on the preload thread, only pause_us is time
+// the caller of cr_plugin_update was blocked.
+struct cr_reload_stats {
+  unsigned int version;   // version after the reload, 0 before any reload
+  int rollback;           // 1 if a crash rolled the plugin back
+  long long detect_us;    // cr_plugin_changed noticing the change
+  long long wait_us;      // from noticing the change to the reload being done
+  long long copy_us;      // copying the binary next to the plugin
+  long long open_us;      // dlopen / LoadLibrary
+  long long symbol_us;    // looking up cr_main
+  long long validate_us;  // cr_plugin_validate_sections
+  long long store_us;     // cr_plugin_sections_store
+  long long restore_us;   // cr_plugin_sections_reload
+  long long unload_us;    // the guest's CR_UNLOAD
+  long long load_us;      // the guest's CR_LOAD
+  long long pause_us;     // total time cr_plugin_update was blocked
+};
+
 #if defined(_MSC_VER)
 #if defined(__cplusplus)
 #define CR_EXPORT extern "C" __declspec(dllexport)
@@ -368,10 +388,51 @@ struct cr_plugin {
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <cassert> // assert
-#include <chrono>  // duration for sleep
+#include <chrono>  // steady_clock for retries
+#include <condition_variable>
+#include <mutex>
 #include <string>
-#include <thread> // this_thread::sleep_for
+#include <thread>
+#include <vector>
+
+// a failed load is retried after CR_RETRY_MIN_MS, doubling on every failure
+// in a row up to CR_RETRY_MAX_MS
+#ifndef CR_RETRY_MIN_MS
+#define CR_RETRY_MIN_MS 10
+#endif
+#ifndef CR_RETRY_MAX_MS
+#define CR_RETRY_MAX_MS 1000
+#endif
+
+// without close-write notifications a changed plugin is loaded once its
+// size has not changed for this long
+#ifndef CR_SETTLE_MS
+#define CR_SETTLE_MS 100
+#endif
+
+// without change notifications cr_plugin_sync_needed asks for a look at the
+// plugin file this often
+#ifndef CR_POLL_MS
+#define CR_POLL_MS 50
+#endif
+
+// previous versions kept loaded, with their state, so rolling back after a
+// crash does not load anything. 0 loads the previous version from disk.
+#ifndef CR_KEEP_VERSIONS
+#define CR_KEEP_VERSIONS 2
+#endif
+
+// track the pages of .state and .bss written by a version so a reload only
+// copies those. 1 uses the soft-dirty bits of linux, when the kernel has
+// them. 2 write protects the sections and records the first write to each
+// page, syscalls writing to the sections then fail with EFAULT instead.
+// 0, or no support, copies the sections whole.
+#ifndef CR_DIRTY_TRACKING
+#define CR_DIRTY_TRACKING 1
+#endif
 
 #if _WIN32
 #define CR_PATH_SEPARATOR '\\'
@@ -440,6 +501,76 @@ struct cr_plugin_segment {
   int64_t size = 0;
 };
 
+// where the global state sections of a loaded image live, found before the
+// image is validated against the running one
+struct cr_plugin_image {
+  bool scanned = false;
+  cr_plugin_segment seg = {};
+  struct {
+    bool found;
+    int64_t vaddr;
+    int64_t base;
+    int64_t size;
+  } sections[cr_plugin_section_type::count] = {};
+};
+
+namespace cr_preload_state {
+  enum e { idle, loading, ready, failed };
+}
+
+// the next version of the plugin, loaded by the preload thread while the
+// current one keeps running
+struct cr_plugin_next {
+  unsigned version = 0;
+  std::string file = {};
+  void *handle = nullptr;
+  cr_plugin_main_func main = nullptr;
+  time_t timestamp = {};
+  cr_plugin_image image = {};
+  // the phases done by the preload thread
+  cr_reload_stats stats = {};
+};
+
+// a previous version kept loaded for an instant rollback, the sections hold
+// where its state lives. The state given back to it is the backup copy, as
+// for a rollback from disk.
+struct cr_plugin_resident {
+  void *handle = nullptr;
+  cr_plugin_main_func main = nullptr;
+  unsigned version = 0;
+  cr_plugin_segment seg = {};
+  cr_plugin_section sections[cr_plugin_section_type::count] = {};
+};
+
+// a version waiting for the threads still running it, see cr_plugin_enter
+struct cr_retired {
+  void *handle = nullptr;
+  // threads that entered at this epoch or before may still run it
+  uint64_t epoch = 0;
+};
+
+// the read-side section of a thread, see cr_plugin_enter
+struct cr_reader {
+  // epoch the thread entered at, 0 while outside
+  std::atomic<uint64_t> epoch{0};
+};
+
+static std::atomic<uint64_t> cr_next_id{1};
+
+// which pages of a state section were written since cr_dirty_begin
+struct cr_dirty_pages {
+  // tracking covers the whole pages the section is in
+  char *begin = nullptr;
+  size_t pages = 0;
+  size_t page_size = 0;
+  std::unique_ptr<std::atomic<uint8_t>[]> written = {};
+  // CR_DIRTY_CHUNK sized parts of the .bss copy written by any version, the
+  // others are zero and so is a new image, they are not restored
+  std::vector<uint8_t> touched = {};
+};
+
+#define CR_DIRTY_CHUNK 4096
+
 // keep track of some internal state about the plugin, should not be messed
 // with by user
 struct cr_internal {
@@ -451,8 +582,122 @@ struct cr_internal {
   cr_plugin_section data[cr_plugin_section_type::count]
     [cr_plugin_section_version::count] = {};
   cr_mode mode = CR_SAFEST;
+  // set by the change watcher when the plugin file may have changed, only
+  // then is the file itself looked at. Without a watcher the file is looked
+  // at on every update.
+  std::atomic<bool> dirty{true};
+  bool watching = false;
+#if defined(__linux__)
+  int watch_fd = -1;
+  int watch_wake_fd = -1;
+  std::thread watcher = {};
+#endif
+  // background preloading, see cr_plugin_preload. next is owned by the
+  // preload thread while next_state is loading, by the updating thread
+  // otherwise.
+  bool preload = false;
+  std::thread loader = {};
+  std::mutex loader_mutex;
+  std::condition_variable loader_cv;
+  bool loader_stop = false;
+  std::atomic<int> next_state{cr_preload_state::idle};
+  cr_plugin_next next = {};
+  // old versions for the preload thread to close
+  std::vector<cr_retired> retired = {};
+  // previous versions to roll back to, newest last
+  std::vector<cr_plugin_resident> resident = {};
+  // failed loads, in total and in a row. The next attempt waits for
+  // retry_at while the current version keeps running.
+  unsigned load_failures = 0;
+  unsigned failed_attempts = 0;
+  std::chrono::steady_clock::time_point retry_at = {};
+  // size-stable check when polling, see cr_plugin_settled
+  size_t seen_size = 0;
+  std::chrono::steady_clock::time_point seen_at = {};
+  // when polling, the steady clock in ms at which the file is looked at
+  // again, read by cr_plugin_sync_needed from any thread
+  std::atomic<long long> poll_at_ms{0};
+  // versions copied next to the plugin, [staged_from, staged_to)
+  unsigned staged_from = 0;
+  unsigned staged_to = 0;
+  // timing of the reload in progress and of the last one done
+  cr_reload_stats reload = {};
+  cr_reload_stats last_reload = {};
+  std::chrono::steady_clock::time_point changed_at = {};
+  // first crash in cr_plugin_call since the last sync, which may be called
+  // from several threads at once. cr_plugin_sync moves it to ctx.failure.
+  std::atomic<int> crashed{CR_NONE};
+  // epoch based reclamation, see cr_plugin_enter. id tells the per thread
+  // reader caches apart, epoch is advanced every time a version is retired.
+  uint64_t id = cr_next_id.fetch_add(1);
+  std::atomic<uint64_t> epoch{1};
+  std::mutex readers_mutex;
+  std::vector<std::unique_ptr<cr_reader>> readers = {};
+  // cr_plugin_sync has to run whatever changed, a failure or no version
+  std::atomic<bool> pending{true};
+  // dirty page tracking, see cr_dirty_begin. synced is set once the copies
+  // in data match the sections, the written pages then keep them matching.
+  cr_dirty_pages pages[cr_plugin_section_type::count];
+  bool dirty_synced = false;
+  bool dirty_tracking = false;
+  uint64_t dirty_generation = 0;
+  int dirty_slot[cr_plugin_section_type::count] = {-1, -1};
 };
 
+static long long cr_steady_ms() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch())
+    .count();
+}
+
+static long long cr_us_since(std::chrono::steady_clock::time_point start) {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+// internal
+// a helper function to validate that an area of memory is empty
+// this is used to validate that the data in the .bss haven't changed
+// and that we are safe to discard it and uses the new one.
+static bool cr_is_empty(const void *const buf, int64_t len) {
+  if (!buf || !len) {
+    return true;
+  }
+
+  auto c = (const char *)buf;
+  int64_t i = 0;
+  for (; i < len && (uintptr_t)(c + i) % sizeof(uint64_t); ++i) {
+    if (c[i]) {
+      return false;
+    }
+  }
+  // a word at a time, 8 at once between checks
+  uint64_t r = 0;
+  for (; i + 8 * (int64_t)sizeof(uint64_t) <= len;
+       i += 8 * sizeof(uint64_t)) {
+    auto w = (const uint64_t *)(c + i);
+    r |= w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7];
+    if (r) {
+      return false;
+    }
+  }
+  for (; i + (int64_t)sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    r |= *(const uint64_t *)(c + i);
+  }
+  for (; i < len; ++i) {
+    r |= (uint8_t)c[i];
+  }
+  return !r;
+}
+
+// internal
+// Record a crash in cr_plugin_call, only the first one is kept.
+static void cr_plugin_crashed(cr_plugin &ctx, cr_failure failure) {
+  auto p = (cr_internal *)ctx.p;
+  int none = CR_NONE;
+  p->crashed.compare_exchange_strong(none, failure);
+}
+
 static bool cr_plugin_section_validate(cr_plugin &ctx,
   cr_plugin_section_type::e type,
   intptr_t vaddr, intptr_t ptr,
@@ -460,12 +705,23 @@ static bool cr_plugin_section_validate(cr_plugin &ctx,
 static void cr_plugin_sections_reload(cr_plugin &ctx,
   cr_plugin_section_version::e version);
 static void cr_plugin_sections_store(cr_plugin &ctx);
-static void cr_plugin_sections_backup(cr_plugin &ctx);
+static void cr_plugin_sections_backup(cr_plugin &ctx, bool tracked);
+static void cr_dirty_begin(cr_plugin &ctx);
+static bool cr_dirty_collect(cr_plugin &ctx);
+static void cr_dirty_end(cr_plugin &ctx);
 static void cr_plugin_reload(cr_plugin &ctx);
 static void cr_plugin_unload(cr_plugin &ctx, bool rollback, bool close);
 static bool cr_plugin_changed(cr_plugin &ctx);
-static bool cr_plugin_rollback(cr_plugin &ctx);
+static void cr_plugin_load_failed(cr_plugin &ctx);
+static void cr_plugin_staged_trim(cr_plugin &ctx, unsigned keep_from);
+static unsigned cr_plugin_staged_keep_from(cr_plugin &ctx);
+static void cr_plugin_keep(cr_plugin &ctx);
+static int cr_plugin_loaded(cr_plugin &ctx,
+  std::chrono::steady_clock::time_point start);
+static bool cr_plugin_rollback(cr_plugin &ctx, bool swap_failed = false);
 static int cr_plugin_main(cr_plugin &ctx, cr_op operation);
+static void cr_watch_start(cr_plugin &ctx);
+static void cr_watch_stop(cr_plugin &ctx);
 
 #if defined(_WIN32)
 
@@ -498,7 +754,7 @@ static std::wstring cr_utf8_to_wstring(const std::string &str) {
   return wpath;
 }
 
-static size_t file_size(const std::string &path) {
+static size_t cr_file_size(const std::string &path) {
   std::wstring wpath = cr_utf8_to_wstring(path);
   WIN32_FILE_ATTRIBUTE_DATA fad;
   if (!GetFileAttributesExW(wpath.c_str(), GetFileExInfoStandard, &fad)) {
@@ -537,6 +793,12 @@ static void cr_copy(const std::string &from, const std::string &to) {
   CopyFileW(wfrom.c_str(), wto.c_str(), false);
 }
 
+static bool cr_del(const std::string &path) {
+  std::wstring wpath = cr_utf8_to_wstring(path);
+  return DeleteFileW(wpath.c_str()) ||
+    GetLastError() == ERROR_FILE_NOT_FOUND;
+}
+
 // If using Microsoft Visual C/C++ compiler we need to do some workaround the
 // fact that the compiled binary has a fullpath to the PDB hardcoded inside
 // it. This causes a lot of headaches when trying compile while debugging as
@@ -824,12 +1086,28 @@ static void cr_pe_section_save(cr_plugin &ctx, cr_plugin_section_type::e type,
     memset((char *)data->data + old_size, '\0',
       shdr.SizeOfRawData - old_size);
   }
+  if (old_size != shdr.SizeOfRawData) {
+    p->dirty_synced = false;
+    p->pages[type].touched.clear();
+  }
+}
+
+static bool cr_plugin_scan_sections(so_handle handle,
+  const std::string &imagefile,
+  cr_plugin_image &image) {
+  (void)handle;
+  (void)imagefile;
+  image = {};
+  return true;
 }
 
 static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
   const std::string &imagefile,
-  bool rollback) {
+  bool rollback,
+  cr_plugin_image *scanned = nullptr) {
+  // the headers are read from memory, there is nothing to do ahead of time
   (void)imagefile;
+  (void)scanned;
   assert(handle);
   auto p = (cr_internal *)ctx.p;
   if (p->mode == CR_DISABLE) {
@@ -872,10 +1150,8 @@ static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
   return result;
 }
 
-static void cr_so_unload(cr_plugin &ctx) {
-  auto p = (cr_internal *)ctx.p;
-  assert(p->handle);
-  FreeLibrary((HMODULE)p->handle);
+static void cr_so_close(so_handle handle) {
+  FreeLibrary(handle);
 }
 
 static so_handle cr_so_load(cr_plugin &ctx, const std::string &filename) {
@@ -898,26 +1174,41 @@ static cr_plugin_main_func cr_so_symbol(so_handle handle) {
 
 static void cr_plat_init() {}
 
-static int cr_seh_filter(cr_plugin &ctx, unsigned long seh) {
+// no dirty page tracking on windows yet, the sections are copied whole
+static void cr_dirty_begin(cr_plugin &ctx) { (void)ctx; }
+static bool cr_dirty_collect(cr_plugin &ctx) {
+  (void)ctx;
+  return false;
+}
+static void cr_dirty_end(cr_plugin &ctx) { (void)ctx; }
+
+// no change notification on windows yet, the file is polled
+static void cr_watch_start(cr_plugin &ctx) { (void)ctx; }
+static void cr_watch_stop(cr_plugin &ctx) { (void)ctx; }
+
+// SEH is per thread already, the failure is written to where the caller
+// asks: ctx.failure, or a local in cr_guard.
+static int cr_seh_filter(cr_plugin &ctx, unsigned long seh,
+  cr_failure &failure) {
   if (ctx.version == 1) {
     return EXCEPTION_CONTINUE_SEARCH;
   }
 
   switch (seh) {
   case EXCEPTION_ACCESS_VIOLATION:
-    ctx.failure = CR_SEGFAULT;
+    failure = CR_SEGFAULT;
     return EXCEPTION_EXECUTE_HANDLER;
   case EXCEPTION_ILLEGAL_INSTRUCTION:
-    ctx.failure = CR_ILLEGAL;
+    failure = CR_ILLEGAL;
     return EXCEPTION_EXECUTE_HANDLER;
   case EXCEPTION_DATATYPE_MISALIGNMENT:
-    ctx.failure = CR_MISALIGN;
+    failure = CR_MISALIGN;
     return EXCEPTION_EXECUTE_HANDLER;
   case EXCEPTION_ARRAY_BOUNDS_EXCEEDED:
-    ctx.failure = CR_BOUNDS;
+    failure = CR_BOUNDS;
     return EXCEPTION_EXECUTE_HANDLER;
   case EXCEPTION_STACK_OVERFLOW:
-    ctx.failure = CR_STACKOVERFLOW;
+    failure = CR_STACKOVERFLOW;
     return EXCEPTION_EXECUTE_HANDLER;
   default:
     break;
@@ -935,13 +1226,31 @@ static int cr_plugin_main(cr_plugin &ctx, cr_op operation) {
     }
 #ifndef __MINGW32__
   }
-  __except (cr_seh_filter(ctx, GetExceptionCode())) {
+  __except (cr_seh_filter(ctx, GetExceptionCode(), ctx.failure)) {
     return -1;
   }
 #endif
   return -1;
 }
 
+// Run fn under the same guard as cr_main, see cr_plugin_call.
+template <typename Function>
+static int cr_guard(cr_plugin &ctx, Function &fn) {
+  cr_failure failure = CR_NONE;
+#ifndef __MINGW32__
+  __try {
+#endif
+    fn();
+#ifndef __MINGW32__
+  }
+  __except (cr_seh_filter(ctx, GetExceptionCode(), failure)) {
+    cr_plugin_crashed(ctx, failure);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
 #endif // _WIN32
 
 #if defined(__unix__)
@@ -957,6 +1266,13 @@ static int cr_plugin_main(cr_plugin &ctx, cr_op operation) {
 #include <sys/stat.h>
 #include <sys/ucontext.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#endif
 
 #define CR_STR "%s"
 #define CR_INT "%d"
@@ -984,36 +1300,62 @@ static bool cr_exists(const std::string &path) {
   return stat(path.c_str(), &stats) != -1;
 }
 
+// The copy is a new file, a version that still has the old one mapped is
+// not affected. Where the filesystem can, the copy shares the blocks of the
+// original (reflink), otherwise the kernel copies without a round trip
+// through user space.
 static void cr_copy(const std::string &from, const std::string &to) {
-  char buffer[BUFSIZ];
-  size_t size;
+  int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (source == -1) {
+    return;
+  }
+  unlink(to.c_str());
+  int destination = open(to.c_str(),
+    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+  if (destination == -1) {
+    close(source);
+    return;
+  }
 
-  FILE *source = fopen(from.c_str(), "rb");
-  FILE *destination = fopen(to.c_str(), "wb");
+  bool copied = false;
+#if defined(__linux__)
+  copied = ioctl(destination, FICLONE, source) == 0;
+  if (!copied) {
+    const auto len = cr_file_size(from);
+    size_t done = 0;
+    while (done < len) {
+      auto n = copy_file_range(source, nullptr, destination, nullptr,
+        len - done, 0);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    copied = done == len;
+    if (!copied) {
+      // not supported across these filesystems, copy what is left by hand
+      lseek(source, done, SEEK_SET);
+      lseek(destination, done, SEEK_SET);
+    }
+  }
+#endif // __linux__
 
-  while ((size = fread(buffer, 1, BUFSIZ, source)) != 0) {
-    fwrite(buffer, 1, size, destination);
+  if (!copied) {
+    char buffer[64 * 1024];
+    ssize_t size;
+    while ((size = read(source, buffer, sizeof(buffer))) > 0) {
+      if (write(destination, buffer, size) != size) {
+        break;
+      }
+    }
   }
 
-  fclose(source);
-  fclose(destination);
+  close(source);
+  close(destination);
 }
 
-// unix,internal
-// a helper function to validate that an area of memory is empty
-// this is used to validate that the data in the .bss haven't changed
-// and that we are safe to discard it and uses the new one.
-bool cr_is_empty(const void *const buf, int64_t len) {
-  if (!buf || !len) {
-    return true;
-  }
-
-  bool r = false;
-  auto c = (const char *const)buf;
-  for (int i = 0; i < len; ++i) {
-    r |= c[i];
-  }
-  return !r;
+static bool cr_del(const std::string &path) {
+  return unlink(path.c_str()) == 0 || errno == ENOENT;
 }
 
 // unix,internal
@@ -1021,77 +1363,59 @@ bool cr_is_empty(const void *const buf, int64_t len) {
 // around global state (from .bss and .state binary sections).
 // vaddr = is the in memory loaded address of the segment-section
 // base = is the in file section address
-// shdr = the in file section header
-template <class H>
-void cr_elf_section_save(cr_plugin &ctx, cr_plugin_section_type::e type,
-  int64_t vaddr, int64_t base, H shdr) {
+// size = the in file section size
+static void cr_elf_section_save(cr_plugin &ctx, cr_plugin_section_type::e type,
+  int64_t vaddr, int64_t base, int64_t size) {
   const auto version = cr_plugin_section_version::current;
   auto p = (cr_internal *)ctx.p;
   auto data = &p->data[type][version];
-  const size_t old_size = data->size;
+  const int64_t old_size = data->size;
   data->base = base;
   data->ptr = (char *)vaddr;
-  data->size = shdr.sh_size;
-  data->data = realloc(data->data, shdr.sh_size);
-  if (old_size < shdr.sh_size) {
-    memset((char *)data->data + old_size, '\0', shdr.sh_size - old_size);
+  data->size = size;
+  data->data = realloc(data->data, size);
+  if (old_size < size) {
+    memset((char *)data->data + old_size, '\0', size - old_size);
+  }
+  if (old_size != size) {
+    p->dirty_synced = false;
+    p->pages[type].touched.clear();
   }
 }
 
 // unix,internal
-// validates that the sections being loaded are compatible with the previous
-// one accordingly with desired `cr_mode` mode. If this is a first load, a
-// validation is not necessary. At the same time it will initialize the
-// section tracking information and alloc the required temporary space to use
-// during unload.
+// find the .state and .bss section headers in the image file, the addresses
+// are resolved against the data segment found in memory.
 template <class H>
-bool cr_elf_validate_sections(cr_plugin &ctx, bool rollback, H shdr, int shnum,
+void cr_elf_scan_sections(cr_plugin_image &image, H shdr, int shnum,
   const char *sh_strtab_p) {
   assert(sh_strtab_p);
-  auto p = (cr_internal *)ctx.p;
-  bool result = true;
   for (int i = 0; i < shnum; ++i) {
     const char *name = sh_strtab_p + shdr[i].sh_name;
     auto sectionHeader = shdr[i];
     const int64_t addr = sectionHeader.sh_addr;
     const int64_t size = sectionHeader.sh_size;
-    const int64_t base = (intptr_t)p->seg.ptr + p->seg.size;
+    const int64_t base = (intptr_t)image.seg.ptr + image.seg.size;
     if (!strcmp(name, ".state")) {
-      const int64_t vaddr = base - size;
-      auto sec = cr_plugin_section_type::state;
-      if (ctx.version || rollback) {
-        result &=
-          cr_plugin_section_validate(ctx, sec, vaddr, addr, size);
-      }
-      if (result) {
-        cr_elf_section_save(ctx, sec, vaddr, addr, sectionHeader);
-      }
+      auto &sec = image.sections[cr_plugin_section_type::state];
+      sec.found = true;
+      sec.vaddr = base - size;
+      sec.base = addr;
+      sec.size = size;
     }
     else if (!strcmp(name, ".bss")) {
       // .bss goes past segment filesz, but it may be just padding
-      const int64_t vaddr = base;
-      auto sec = cr_plugin_section_type::bss;
-      if (ctx.version || rollback) {
-        // this is kinda hack to skip bss validation if our data is zero
-        // this means we don't care scrapping it, and helps skipping
-        // validating a .bss that serves only as padding in the segment.
-        if (!cr_is_empty(p->data[sec][0].data, p->data[sec][0].size)) {
-          result &=
-            cr_plugin_section_validate(ctx, sec, vaddr, addr, size);
-        }
-      }
-      if (result) {
-        cr_elf_section_save(ctx, sec, vaddr, addr, sectionHeader);
-      }
+      auto &sec = image.sections[cr_plugin_section_type::bss];
+      sec.found = true;
+      sec.vaddr = base;
+      sec.base = addr;
+      sec.size = size;
     }
   }
-  return result;
 }
 
 struct cr_ld_data {
-  cr_plugin *ctx = nullptr;
-  int64_t data_segment_address = 0;
-  int64_t data_segment_size = 0;
+  cr_plugin_image *image = nullptr;
   const char *fullname = nullptr;
 };
 
@@ -1113,7 +1437,6 @@ static int cr_dl_header_handler(struct dl_phdr_info *info, size_t size,
   void *data) {
   assert(info && data);
   auto p = (cr_ld_data *)data;
-  auto ctx = p->ctx;
   if (strcasecmp(info->dlpi_name, p->fullname)) {
     return 0;
   }
@@ -1129,25 +1452,24 @@ static int cr_dl_header_handler(struct dl_phdr_info *info, size_t size,
     // issue we fix it by comparing against section addresses, but this
     // will require some rework on the code flow.
     if (phdr.p_flags & PF_W) {
-      auto pimpl = (cr_internal *)ctx->p;
-      pimpl->seg.ptr = (char *)(info->dlpi_addr + phdr.p_vaddr);
-      pimpl->seg.size = phdr.p_filesz;
+      p->image->seg.ptr = (char *)(info->dlpi_addr + phdr.p_vaddr);
+      p->image->seg.size = phdr.p_filesz;
       break;
     }
   }
   return 0;
 }
 
-static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
+// unix,internal
+// find where the global state sections of a loaded image live. Does not
+// touch the plugin context, so it can run ahead of time on another thread.
+static bool cr_plugin_scan_sections(so_handle handle,
   const std::string &imagefile,
-  bool rollback) {
+  cr_plugin_image &image) {
   assert(handle);
+  image = {};
   cr_ld_data data;
-  data.ctx = &ctx;
-  auto pimpl = (cr_internal *)ctx.p;
-  if (pimpl->mode == CR_DISABLE) {
-    return true;
-  }
+  data.image = &image;
   data.fullname = imagefile.c_str();
   dl_iterate_phdr(cr_dl_header_handler, (void *)&data);
 
@@ -1158,6 +1480,10 @@ static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
     int fd = open(imagefile.c_str(), O_RDONLY);
     p = (char *)mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
     close(fd);
+    if (p == MAP_FAILED) {
+      p = nullptr;
+      break;
+    }
 
     auto ehdr = (Elf32_Ehdr *)p;
     if (ehdr->e_ident[EI_MAG0] != ELFMAG0 ||
@@ -1171,23 +1497,67 @@ static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
       auto shdr = (Elf32_Shdr *)(p + ehdr->e_shoff);
       auto sh_strtab = &shdr[ehdr->e_shstrndx];
       const char *const sh_strtab_p = p + sh_strtab->sh_offset;
-      result = cr_elf_validate_sections(ctx, rollback, shdr,
-        ehdr->e_shnum, sh_strtab_p);
+      cr_elf_scan_sections(image, shdr, ehdr->e_shnum, sh_strtab_p);
     }
     else {
       auto ehdr = (Elf64_Ehdr *)p; // shadow
       auto shdr = (Elf64_Shdr *)(p + ehdr->e_shoff);
       auto sh_strtab = &shdr[ehdr->e_shstrndx];
       const char *const sh_strtab_p = p + sh_strtab->sh_offset;
-      result = cr_elf_validate_sections(ctx, rollback, shdr,
-        ehdr->e_shnum, sh_strtab_p);
+      cr_elf_scan_sections(image, shdr, ehdr->e_shnum, sh_strtab_p);
     }
+    result = true;
   } while (0);
 
   if (p) {
     munmap(p, len);
   }
 
+  image.scanned = result;
+  return result;
+}
+
+// unix,internal
+// validates that the sections being loaded are compatible with the previous
+// one accordingly with desired `cr_mode` mode. If this is a first load, a
+// validation is not necessary. At the same time it will initialize the
+// section tracking information and alloc the required temporary space to use
+// during unload. The image is scanned first unless the caller already did.
+static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
+  const std::string &imagefile,
+  bool rollback,
+  cr_plugin_image *scanned = nullptr) {
+  auto p = (cr_internal *)ctx.p;
+  if (p->mode == CR_DISABLE) {
+    return true;
+  }
+
+  cr_plugin_image local;
+  cr_plugin_image &image = scanned ? *scanned : local;
+  bool result = image.scanned || cr_plugin_scan_sections(handle, imagefile, image);
+  p->seg = image.seg;
+
+  for (int i = 0; result && i < cr_plugin_section_type::count; ++i) {
+    const auto sec = (cr_plugin_section_type::e)i;
+    const auto &found = image.sections[sec];
+    if (!found.found) {
+      continue;
+    }
+    if (ctx.version || rollback) {
+      // this is kinda hack to skip bss validation if our data is zero
+      // this means we don't care scrapping it, and helps skipping
+      // validating a .bss that serves only as padding in the segment.
+      if (sec != cr_plugin_section_type::bss ||
+        !cr_is_empty(p->data[sec][0].data, p->data[sec][0].size)) {
+        result &= cr_plugin_section_validate(ctx, sec, found.vaddr,
+          found.base, found.size);
+      }
+    }
+    if (result) {
+      cr_elf_section_save(ctx, sec, found.vaddr, found.base, found.size);
+    }
+  }
+
   if (!result) {
     ctx.failure = CR_STATE_INVALIDATED;
   }
@@ -1195,21 +1565,63 @@ static bool cr_plugin_validate_sections(cr_plugin &ctx, so_handle handle,
   return result;
 }
 
-static void cr_so_unload(cr_plugin &ctx) {
-  assert(ctx.p);
-  auto p = (cr_internal *)ctx.p;
-  assert(p->handle);
-
-  const int r = dlclose(p->handle);
+static void cr_so_close(so_handle handle) {
+  const int r = dlclose(handle);
   if (r) {
     fprintf(stderr, "Error closing plugin: %d\n", r);
   }
+}
+
+// unix,internal
+// Checks that the file holds everything its ELF headers point at. dlopen maps
+// the segments without looking at the file size and faults on the missing
+// pages of a file that is still being written.
+template <typename Ehdr, typename Phdr>
+static bool cr_elf_complete(int fd, size_t len) {
+  Ehdr ehdr;
+  if (pread(fd, &ehdr, sizeof(ehdr), 0) != (ssize_t)sizeof(ehdr)) {
+    return false;
+  }
+  if (ehdr.e_shoff + (size_t)ehdr.e_shnum * ehdr.e_shentsize > len ||
+    ehdr.e_phoff + (size_t)ehdr.e_phnum * sizeof(Phdr) > len) {
+    return false;
+  }
+  for (size_t i = 0; i < ehdr.e_phnum; ++i) {
+    Phdr phdr;
+    const off_t at = ehdr.e_phoff + i * sizeof(Phdr);
+    if (pread(fd, &phdr, sizeof(phdr), at) != (ssize_t)sizeof(phdr) ||
+      phdr.p_offset + phdr.p_filesz > len) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  p->handle = nullptr;
-  p->main = nullptr;
+// unix,internal
+static bool cr_elf_complete(const std::string &path) {
+  const auto len = cr_file_size(path);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  unsigned char ident[EI_NIDENT] = {};
+  bool result = pread(fd, ident, EI_NIDENT, 0) == EI_NIDENT &&
+    memcmp(ident, ELFMAG, SELFMAG) == 0;
+  if (result) {
+    result = ident[EI_CLASS] == ELFCLASS32
+      ? cr_elf_complete<Elf32_Ehdr, Elf32_Phdr>(fd, len)
+      : cr_elf_complete<Elf64_Ehdr, Elf64_Phdr>(fd, len);
+  }
+  close(fd);
+  return result;
 }
 
 static so_handle cr_so_load(cr_plugin &ctx, const std::string &new_file) {
+  if (cr_exists(new_file) && !cr_elf_complete(new_file)) {
+    fprintf(stderr, "Couldn't load plugin: %s is incomplete\n",
+      new_file.c_str());
+    return nullptr;
+  }
   dlerror();
   auto new_dll = dlopen(new_file.c_str(), RTLD_NOW);
   if (!new_dll) {
@@ -1228,83 +1640,452 @@ static cr_plugin_main_func cr_so_symbol(so_handle handle) {
   return new_main;
 }
 
-volatile std::sig_atomic_t cr_signal = 0;
-sigjmp_buf env;
+// The crash guard of a thread. A fault is delivered to the thread that
+// caused it, so the handler jumps back to the guard of that thread and
+// several threads can be inside the plugin at once.
+struct cr_thread_guard {
+  sigjmp_buf env;
+  volatile std::sig_atomic_t signal = 0;
+  // set while the thread runs guarded plugin code
+  volatile std::sig_atomic_t active = 0;
+};
+
+static thread_local cr_thread_guard cr_guard_state;
+
+static const long cr_page_size = sysconf(_SC_PAGESIZE);
+
+namespace cr_dirty_mode {
+  enum e { none, soft_dirty, write_protect };
+}
+
+// a write protected section, looked at from the signal handler. A range stays
+// in place until its slot tracks the next version, see cr_dirty_fault.
+struct cr_dirty_range {
+  std::atomic<char *> begin{nullptr};
+  std::atomic<size_t> pages{0};
+  std::atomic<std::atomic<uint8_t> *> written{nullptr};
+  std::atomic<bool> tracking{false};
+  std::atomic<bool> used{false};
+};
+
+static cr_dirty_range cr_dirty_ranges[16];
+
+// bumped on every soft-dirty clear, which is for the whole process: a plugin
+// that sees it moved did not see all its writes
+static std::atomic<uint64_t> cr_soft_dirty_generation{0};
+
+// unix,internal
+// A write to a write protected section records the page and lets the write
+// through. False for any other fault. .state and .bss may share a page.
+static bool cr_dirty_fault(void *addr) {
+  bool found = false;
+  for (auto &range : cr_dirty_ranges) {
+    char *begin = range.begin.load(std::memory_order_acquire);
+    const size_t len = range.pages.load() * cr_page_size;
+    if (!begin || (char *)addr < begin || (char *)addr >= begin + len) {
+      continue;
+    }
+    const size_t page = ((char *)addr - begin) / cr_page_size;
+    if (range.tracking.load()) {
+      range.written.load()[page] = 1;
+    }
+    mprotect(begin + page * cr_page_size, cr_page_size,
+      PROT_READ | PROT_WRITE);
+    found = true;
+  }
+  return found;
+}
 
 static void cr_signal_handler(int sig, siginfo_t *si, void *uap) {
   (void)uap;
   assert(si);
   //printf("Signal %d raised at address: %p\n", sig, si->si_addr);
+  if (sig == SIGSEGV && CR_DIRTY_TRACKING == 2 &&
+    cr_dirty_fault(si->si_addr)) {
+    return;
+  }
+  auto &guard = cr_guard_state;
+  if (!guard.active) {
+    // not the plugin's fault, let the default action take the process down
+    // once the faulting instruction runs again or abort raises again
+    struct sigaction sa {};
+    sa.sa_handler = SIG_DFL;
+    sigaction(sig, &sa, nullptr);
+    return;
+  }
   // we may want to pass more info about the failure here
-  cr_signal = sig;
-  siglongjmp(env, sig);
+  guard.active = 0;
+  guard.signal = sig;
+  siglongjmp(guard.env, sig);
 }
 
-static void cr_plat_init() {
-  struct sigaction sa;
-  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
-  sigemptyset(&sa.sa_mask);
-  sa.sa_sigaction = cr_signal_handler;
-  sa.sa_restorer = nullptr;
-
-  if (sigaction(SIGILL, &sa, nullptr) == -1) {
-    fprintf(stderr, "Failed to setup SIGILL handler\n");
-  }
-  if (sigaction(SIGBUS, &sa, nullptr) == -1) {
-    fprintf(stderr, "Failed to setup SIGBUS handler\n");
+#if defined(__linux__)
+// unix,internal
+static bool cr_soft_dirty_clear() {
+  const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
   }
-  if (sigaction(SIGSEGV, &sa, nullptr) == -1) {
-    fprintf(stderr, "Failed to setup SIGSEGV handler\n");
+  const bool cleared = write(fd, "4", 1) == 1;
+  close(fd);
+  cr_soft_dirty_generation++;
+  return cleared;
+}
+
+// unix,internal
+// The soft-dirty bit of every page in [begin, begin + pages), from the page
+// table entries in /proc/self/pagemap.
+static bool cr_soft_dirty_read(char *begin, size_t pages,
+  std::atomic<uint8_t> *written) {
+  const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
   }
-  if (sigaction(SIGABRT, &sa, nullptr) == -1) {
-    fprintf(stderr, "Failed to setup SIGABRT handler\n");
+  std::vector<uint64_t> entries(pages);
+  const auto len = (ssize_t)(pages * sizeof(uint64_t));
+  const auto at = (off_t)((uintptr_t)begin / cr_page_size * sizeof(uint64_t));
+  const bool read = pread(fd, entries.data(), len, at) == len;
+  close(fd);
+  for (size_t i = 0; read && i < pages; ++i) {
+    written[i] = (entries[i] >> 55) & 1;
   }
+  return read;
 }
 
-static cr_failure cr_signal_to_failure(int sig) {
-  switch (sig) {
-  case 0:
-    return CR_NONE;
-  case SIGILL:
-    return CR_ILLEGAL;
-  case SIGBUS:
-    return CR_MISALIGN;
-  case SIGSEGV:
-    return CR_SEGFAULT;
-  case SIGABRT:
-    return CR_ABORT;
+// unix,internal
+// Kernels built without soft-dirty accept the clear and never set the bit.
+static bool cr_soft_dirty_works() {
+  auto page = (char *)mmap(nullptr, cr_page_size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED) {
+    return false;
   }
-  return static_cast<cr_failure>(CR_OTHER + sig);
+  std::atomic<uint8_t> written{0};
+  *(volatile char *)page = 1;
+  bool works = cr_soft_dirty_clear() && cr_soft_dirty_read(page, 1, &written) &&
+    !written;
+  *(volatile char *)page = 2;
+  works = works && cr_soft_dirty_read(page, 1, &written) && written;
+  munmap(page, cr_page_size);
+  return works;
 }
+#endif
 
-static int cr_plugin_main(cr_plugin &ctx, cr_op operation) {
-  if (sigsetjmp(env, 0)) {
-    ctx.failure = cr_signal_to_failure(cr_signal);
-    cr_signal = 0;
-    return -1;
-  }
-  else {
-    auto p = (cr_internal *)ctx.p;
-    assert(p);
-    if (p->main) {
-      return p->main(&ctx, operation);
+// unix,internal
+static cr_dirty_mode::e cr_dirty_mode_get() {
+  static const cr_dirty_mode::e mode = [] {
+    if (CR_DIRTY_TRACKING == 2) {
+      return cr_dirty_mode::write_protect;
     }
-  }
-
-  return -1;
+#if defined(__linux__)
+    if (CR_DIRTY_TRACKING == 1 && cr_soft_dirty_works()) {
+      return cr_dirty_mode::soft_dirty;
+    }
+#endif
+    return cr_dirty_mode::none;
+  }();
+  return mode;
 }
-#endif // __unix__
 
-static bool cr_plugin_load_internal(cr_plugin &ctx, bool rollback) {
+// unix,internal
+// Stop write protecting the sections, what was written so far stays.
+static void cr_dirty_unprotect(cr_plugin &ctx) {
   auto p = (cr_internal *)ctx.p;
-  const auto file = p->fullname;
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    if (p->dirty_slot[i] < 0) {
+      continue;
+    }
+    auto &range = cr_dirty_ranges[p->dirty_slot[i]];
+    if (range.tracking.exchange(false)) {
+      mprotect(range.begin.load(), range.pages.load() * cr_page_size,
+        PROT_READ | PROT_WRITE);
+    }
+  }
+}
+
+// unix,internal
+// Start tracking the writes to the state sections of the version now in
+// place. Its state must be in the sections already, cr_plugin_sections_store
+// then only copies the written pages.
+static void cr_dirty_begin(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  const auto mode = cr_dirty_mode_get();
+  cr_dirty_unprotect(ctx);
+  p->dirty_tracking = false;
+  if (mode == cr_dirty_mode::none || p->mode == CR_DISABLE ||
+    !p->dirty_synced) {
+    return;
+  }
+
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    const auto &cur = p->data[i][cr_plugin_section_version::current];
+    auto &dirty = p->pages[i];
+    if (!cur.ptr || !cur.size) {
+      dirty.begin = nullptr;
+      dirty.pages = 0;
+      continue;
+    }
+    auto begin = (char *)((uintptr_t)cur.ptr & ~(uintptr_t)(cr_page_size - 1));
+    const size_t pages =
+      (cur.ptr + cur.size - begin + cr_page_size - 1) / cr_page_size;
+    if (mode == cr_dirty_mode::write_protect && p->dirty_slot[i] < 0) {
+      for (int slot = 0; slot < (int)(sizeof(cr_dirty_ranges) /
+             sizeof(cr_dirty_ranges[0])); ++slot) {
+        if (!cr_dirty_ranges[slot].used.exchange(true)) {
+          p->dirty_slot[i] = slot;
+          break;
+        }
+      }
+      if (p->dirty_slot[i] < 0) {
+        return;
+      }
+    }
+    if (mode == cr_dirty_mode::write_protect) {
+      // out of the handler's sight before the arrays change
+      cr_dirty_ranges[p->dirty_slot[i]].begin = nullptr;
+    }
+    if (pages > dirty.pages || !dirty.written) {
+      dirty.written.reset(new std::atomic<uint8_t>[pages]);
+    }
+    dirty.begin = begin;
+    dirty.pages = pages;
+    dirty.page_size = cr_page_size;
+    for (size_t page = 0; page < pages; ++page) {
+      dirty.written[page] = 0;
+    }
+  }
+
+#if defined(__linux__)
+  if (mode == cr_dirty_mode::soft_dirty) {
+    p->dirty_tracking = cr_soft_dirty_clear();
+    p->dirty_generation = cr_soft_dirty_generation;
+    return;
+  }
+#endif
+  bool tracking = true;
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    const auto &dirty = p->pages[i];
+    if (!dirty.begin) {
+      continue;
+    }
+    auto &range = cr_dirty_ranges[p->dirty_slot[i]];
+    range.pages = dirty.pages;
+    range.written = dirty.written.get();
+    range.tracking = true;
+    range.begin.store(dirty.begin, std::memory_order_release);
+    tracking &= mprotect(dirty.begin, dirty.pages * cr_page_size,
+      PROT_READ) == 0;
+  }
+  if (!tracking) {
+    cr_dirty_unprotect(ctx);
+  }
+  p->dirty_tracking = tracking;
+}
+
+// unix,internal
+// Stop tracking and fill in the written pages. False if they are not known,
+// the sections are then copied whole.
+static bool cr_dirty_collect(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  if (!p->dirty_tracking) {
+    return false;
+  }
+  p->dirty_tracking = false;
+  bool known = p->dirty_synced;
+#if defined(__linux__)
+  if (cr_dirty_mode_get() == cr_dirty_mode::soft_dirty) {
+    known &= p->dirty_generation == cr_soft_dirty_generation;
+    for (int i = 0; known && i < cr_plugin_section_type::count; ++i) {
+      const auto &dirty = p->pages[i];
+      if (dirty.begin) {
+        known &= cr_soft_dirty_read(dirty.begin, dirty.pages,
+          dirty.written.get());
+      }
+    }
+    return known;
+  }
+#endif
+  cr_dirty_unprotect(ctx);
+  return known;
+}
+
+// unix,internal
+// Give up the ranges of the plugin, used during shutdown.
+static void cr_dirty_end(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  cr_dirty_unprotect(ctx);
+  p->dirty_tracking = false;
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    if (p->dirty_slot[i] >= 0) {
+      auto &range = cr_dirty_ranges[p->dirty_slot[i]];
+      range.begin = nullptr;
+      range.used = false;
+      p->dirty_slot[i] = -1;
+    }
+  }
+}
+
+static void cr_plat_init() {
+  struct sigaction sa;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = cr_signal_handler;
+  sa.sa_restorer = nullptr;
+
+  if (sigaction(SIGILL, &sa, nullptr) == -1) {
+    fprintf(stderr, "Failed to setup SIGILL handler\n");
+  }
+  if (sigaction(SIGBUS, &sa, nullptr) == -1) {
+    fprintf(stderr, "Failed to setup SIGBUS handler\n");
+  }
+  if (sigaction(SIGSEGV, &sa, nullptr) == -1) {
+    fprintf(stderr, "Failed to setup SIGSEGV handler\n");
+  }
+  if (sigaction(SIGABRT, &sa, nullptr) == -1) {
+    fprintf(stderr, "Failed to setup SIGABRT handler\n");
+  }
+}
+
+static cr_failure cr_signal_to_failure(int sig) {
+  switch (sig) {
+  case 0:
+    return CR_NONE;
+  case SIGILL:
+    return CR_ILLEGAL;
+  case SIGBUS:
+    return CR_MISALIGN;
+  case SIGSEGV:
+    return CR_SEGFAULT;
+  case SIGABRT:
+    return CR_ABORT;
+  }
+  return static_cast<cr_failure>(CR_OTHER + sig);
+}
+
+static int cr_plugin_main(cr_plugin &ctx, cr_op operation) {
+  auto &guard = cr_guard_state;
+  if (sigsetjmp(guard.env, 0)) {
+    ctx.failure = cr_signal_to_failure(guard.signal);
+    guard.signal = 0;
+    return -1;
+  }
+  else {
+    auto p = (cr_internal *)ctx.p;
+    assert(p);
+    if (p->main) {
+      guard.active = 1;
+      int r = p->main(&ctx, operation);
+      guard.active = 0;
+      return r;
+    }
+  }
+
+  return -1;
+}
+
+// Run fn under the same guard as cr_main, see cr_plugin_call.
+template <typename Function>
+static int cr_guard(cr_plugin &ctx, Function &fn) {
+  auto &guard = cr_guard_state;
+  if (sigsetjmp(guard.env, 0)) {
+    cr_plugin_crashed(ctx, cr_signal_to_failure(guard.signal));
+    guard.signal = 0;
+    return -1;
+  }
+  guard.active = 1;
+  fn();
+  guard.active = 0;
+  return 0;
+}
+
+#if defined(__linux__)
+// unix,internal
+// Watch the plugin's directory with inotify from a background thread and
+// mark the plugin dirty when its file is closed after writing or moved in,
+// that is once it is completely written. The directory is watched since
+// build tools often replace the file, which would drop a watch on the file
+// itself.
+static void cr_watch_start(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  std::string folder, filename, ext;
+  cr_split_path(p->fullname, folder, filename, ext);
+  const std::string name = filename + ext;
+  if (folder.empty()) {
+    folder = ".";
+  }
+
+  p->watch_fd = inotify_init1(IN_CLOEXEC);
+  p->watch_wake_fd = eventfd(0, EFD_CLOEXEC);
+  const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO;
+  if (p->watch_fd == -1 || p->watch_wake_fd == -1 ||
+    inotify_add_watch(p->watch_fd, folder.c_str(), mask) == -1) {
+    fprintf(stderr, "Couldn't watch plugin, polling it instead\n");
+    cr_watch_stop(ctx);
+    return;
+  }
+
+  p->watching = true;
+  p->watcher = std::thread([p, name] {
+    alignas(struct inotify_event) char buffer[4096];
+    pollfd fds[2] = {{p->watch_fd, POLLIN, 0}, {p->watch_wake_fd, POLLIN, 0}};
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR) {
+      if (fds[1].revents) {
+        break;
+      }
+      if (!(fds[0].revents & POLLIN)) {
+        continue;
+      }
+
+      const ssize_t len = read(p->watch_fd, buffer, sizeof(buffer));
+      for (ssize_t i = 0; i < len;) {
+        auto event = (const struct inotify_event *)(buffer + i);
+        if (event->len && name == event->name) {
+          p->dirty.store(true, std::memory_order_release);
+        }
+        i += sizeof(struct inotify_event) + event->len;
+      }
+    }
+  });
+}
+
+static void cr_watch_stop(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  if (p->watcher.joinable()) {
+    const uint64_t one = 1;
+    (void)!write(p->watch_wake_fd, &one, sizeof(one));
+    p->watcher.join();
+  }
+  if (p->watch_fd != -1) {
+    close(p->watch_fd);
+  }
+  if (p->watch_wake_fd != -1) {
+    close(p->watch_wake_fd);
+  }
+  p->watch_fd = -1;
+  p->watch_wake_fd = -1;
+  p->watching = false;
+}
+#else
+// no change notification, the file is polled
+static void cr_watch_start(cr_plugin &ctx) { (void)ctx; }
+static void cr_watch_stop(cr_plugin &ctx) { (void)ctx; }
+#endif // __linux__
+#endif // __unix__
+
+static bool cr_plugin_load_internal(cr_plugin &ctx, bool rollback) {
+  auto p = (cr_internal *)ctx.p;
+  const auto file = p->fullname;
   if (cr_exists(file) || rollback) {
     const auto new_file = cr_version_path(file, ctx.version);
 
     const bool close = false;
-    cr_plugin_unload(ctx, rollback, close);
-    if (!rollback) {
+    if (rollback) {
+      cr_plugin_unload(ctx, rollback, close);
+    }
+    else {
+      auto start = std::chrono::steady_clock::now();
       cr_copy(file, new_file);
+      p->staged_to = std::max(p->staged_to, ctx.version + 1);
 
 #if defined(_MSC_VER)
       auto new_pdb = cr_replace_extension(new_file, ".pdb");
@@ -1314,30 +2095,43 @@ static bool cr_plugin_load_internal(cr_plugin &ctx, bool rollback) {
           "affected and/or reload may fail\n");
       }
 #endif // defined(_MSC_VER)
+      p->reload.copy_us = cr_us_since(start);
     }
 
+    // loaded before the running version is unloaded, if the compiler is
+    // still writing the binary the running version simply keeps running
+    // and the load is retried later, see cr_plugin_load_failed.
+    auto start = std::chrono::steady_clock::now();
     auto new_dll = cr_so_load(ctx, new_file);
+    p->reload.open_us = cr_us_since(start);
     if (!new_dll) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      // we may want set a failure reason and avoid sleeping ourselves.
-      // this may happen mostly due to compiler still writing the binary
-      // to the disk, so for now we just sleep a bit, but ideally we
-      // may want to report this to the user to deal with it.
       return false;
     }
 
-    if (!cr_plugin_validate_sections(ctx, new_dll, new_file, rollback)) {
+    if (!rollback) {
+      cr_plugin_unload(ctx, rollback, close);
+    }
+
+    start = std::chrono::steady_clock::now();
+    const bool valid =
+      cr_plugin_validate_sections(ctx, new_dll, new_file, rollback);
+    p->reload.validate_us = cr_us_since(start);
+    if (!valid) {
       return false;
     }
 
+    start = std::chrono::steady_clock::now();
     if (rollback) {
       cr_plugin_sections_reload(ctx, cr_plugin_section_version::backup);
     }
     else if (ctx.version) {
       cr_plugin_sections_reload(ctx, cr_plugin_section_version::current);
     }
+    p->reload.restore_us = cr_us_since(start);
 
+    start = std::chrono::steady_clock::now();
     auto new_main = cr_so_symbol(new_dll);
+    p->reload.symbol_us = cr_us_since(start);
     if (!new_main) {
       return false;
     }
@@ -1347,6 +2141,10 @@ static bool cr_plugin_load_internal(cr_plugin &ctx, bool rollback) {
     p->main = new_main;
     p->timestamp = cr_last_write_time(file);
     ctx.version++;
+    cr_dirty_begin(ctx);
+    if (!rollback) {
+      cr_plugin_staged_trim(ctx, cr_plugin_staged_keep_from(ctx));
+    }
   }
   else {
     fprintf(stderr, "Error loading plugin.\n");
@@ -1355,6 +2153,277 @@ static bool cr_plugin_load_internal(cr_plugin &ctx, bool rollback) {
   return true;
 }
 
+// internal
+// Runs on the preload thread: copy, load and inspect the next version while
+// the current one keeps running. Nothing of the running version is touched.
+static bool cr_plugin_preload_next(cr_plugin &ctx, cr_plugin_next &next) {
+  auto p = (cr_internal *)ctx.p;
+  const auto &file = p->fullname;
+  if (!cr_exists(file)) {
+    return false;
+  }
+
+  // taken before the copy, a write during the copy is then seen as a change
+  next.timestamp = cr_last_write_time(file);
+  auto start = std::chrono::steady_clock::now();
+  cr_copy(file, next.file);
+#if defined(_MSC_VER)
+  auto new_pdb = cr_replace_extension(next.file, ".pdb");
+  if (!cr_pdb_process(next.file, new_pdb)) {
+    fprintf(stderr, "Couldn't process PDB, debugging may be "
+      "affected and/or reload may fail\n");
+  }
+#endif // defined(_MSC_VER)
+  next.stats.copy_us = cr_us_since(start);
+
+  start = std::chrono::steady_clock::now();
+  auto new_dll = cr_so_load(ctx, next.file);
+  next.stats.open_us = cr_us_since(start);
+  if (!new_dll) {
+    return false;
+  }
+
+  start = std::chrono::steady_clock::now();
+  next.main = cr_so_symbol(new_dll);
+  next.stats.symbol_us = cr_us_since(start);
+
+  start = std::chrono::steady_clock::now();
+  const bool scanned = p->mode == CR_DISABLE ||
+    cr_plugin_scan_sections(new_dll, next.file, next.image);
+  next.stats.validate_us = cr_us_since(start);
+  if (!next.main || !scanned) {
+    cr_so_close(new_dll);
+    return false;
+  }
+
+  next.handle = new_dll;
+  return true;
+}
+
+// internal
+// Whether every thread that entered at epoch or before has left.
+static bool cr_plugin_quiescent(cr_internal *p, uint64_t epoch) {
+  std::lock_guard<std::mutex> lock(p->readers_mutex);
+  for (const auto &reader : p->readers) {
+    const uint64_t entered = reader->epoch.load();
+    if (entered != 0 && entered <= epoch) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// internal
+// Close the retired versions no thread can be running anymore, and keep the
+// others. With wait, wait for the threads to leave and close them all.
+static void cr_plugin_close_retired(cr_internal *p,
+  std::vector<cr_retired> &retired, bool wait) {
+  auto keep = std::remove_if(retired.begin(), retired.end(),
+    [p, wait](const cr_retired &r) {
+      while (!cr_plugin_quiescent(p, r.epoch)) {
+        if (!wait) {
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      cr_so_close((so_handle)r.handle);
+      return true;
+    });
+  retired.erase(keep, retired.end());
+}
+
+// internal
+// The preload thread, loads what cr_plugin_reload asks for and closes the
+// versions it retired.
+static void cr_plugin_loader(cr_plugin *ctx) {
+  auto p = (cr_internal *)ctx->p;
+  std::unique_lock<std::mutex> lock(p->loader_mutex);
+  // retired versions some thread may still be running
+  std::vector<cr_retired> retired;
+  for (;;) {
+    auto wake = [p] {
+      return p->loader_stop || !p->retired.empty() ||
+        p->next_state.load() == cr_preload_state::loading;
+    };
+    if (retired.empty()) {
+      p->loader_cv.wait(lock, wake);
+    }
+    else {
+      p->loader_cv.wait_for(lock, std::chrono::milliseconds(1), wake);
+    }
+
+    retired.insert(retired.end(), p->retired.begin(), p->retired.end());
+    p->retired.clear();
+    const bool stop = p->loader_stop;
+    const bool load = p->next_state.load() == cr_preload_state::loading;
+    lock.unlock();
+
+    cr_plugin_close_retired(p, retired, stop);
+    if (load) {
+      const bool loaded = cr_plugin_preload_next(*ctx, p->next);
+      p->next_state.store(loaded ? cr_preload_state::ready
+        : cr_preload_state::failed, std::memory_order_release);
+    }
+
+    lock.lock();
+    if (stop) {
+      break;
+    }
+  }
+}
+
+// internal
+// Hand a version to the preload thread to close, closing can take as long as
+// loading. It is closed once every thread that may still run it has left
+// its cr_plugin_enter section. Without a preload thread, waits for that and
+// closes it right away.
+static void cr_plugin_retire(cr_plugin &ctx, void *handle) {
+  auto p = (cr_internal *)ctx.p;
+  // readers that enter from now on see whatever replaced the version
+  const cr_retired retired = {handle, p->epoch.fetch_add(1)};
+  if (!p->loader.joinable()) {
+    std::vector<cr_retired> list = {retired};
+    cr_plugin_close_retired(p, list, true);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(p->loader_mutex);
+    p->retired.push_back(retired);
+  }
+  p->loader_cv.notify_one();
+}
+
+// internal
+// Swap in the preloaded version, like cr_plugin_load_internal but the copy,
+// load and symbol lookup are already done.
+static bool cr_plugin_swap(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  auto &next = p->next;
+
+  auto &stats = p->reload;
+  stats.copy_us = next.stats.copy_us;
+  stats.open_us = next.stats.open_us;
+  stats.symbol_us = next.stats.symbol_us;
+
+  if (p->handle) {
+    auto start = std::chrono::steady_clock::now();
+    cr_plugin_main(ctx, CR_UNLOAD);
+    stats.unload_us = cr_us_since(start);
+    start = std::chrono::steady_clock::now();
+    cr_plugin_sections_store(ctx);
+    stats.store_us = cr_us_since(start);
+    cr_plugin_keep(ctx);
+    p->handle = nullptr;
+    p->main = nullptr;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  const bool valid = cr_plugin_validate_sections(ctx,
+    (so_handle)next.handle, next.file, false, &next.image);
+  // the scan was done by the preload thread
+  stats.validate_us = next.stats.validate_us + cr_us_since(start);
+  if (!valid) {
+    cr_plugin_retire(ctx, next.handle);
+    next.handle = nullptr;
+    return false;
+  }
+
+  start = std::chrono::steady_clock::now();
+  if (ctx.version) {
+    cr_plugin_sections_reload(ctx, cr_plugin_section_version::current);
+  }
+  stats.restore_us = cr_us_since(start);
+
+  p->handle = next.handle;
+  p->main = next.main;
+  p->timestamp = next.timestamp;
+  next.handle = nullptr;
+  ctx.version++;
+  cr_dirty_begin(ctx);
+  cr_plugin_staged_trim(ctx, cr_plugin_staged_keep_from(ctx));
+  return true;
+}
+
+// internal
+// cr_plugin_reload when preloading: ask the preload thread for a change, and
+// swap it in once it is loaded. Nothing but a couple of atomic loads while
+// nothing changed.
+static void cr_plugin_preload_reload(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  const int state = p->next_state.load(std::memory_order_acquire);
+  const auto start = std::chrono::steady_clock::now();
+
+  if (state == cr_preload_state::idle) {
+    if (cr_plugin_changed(ctx)) {
+      p->changed_at = start;
+      p->reload = {};
+      p->reload.detect_us = cr_us_since(start);
+      {
+        std::lock_guard<std::mutex> lock(p->loader_mutex);
+        p->next.version = ctx.version;
+        p->next.stats = {};
+        p->next.file = cr_version_path(p->fullname, ctx.version);
+        p->staged_to = std::max(p->staged_to, ctx.version + 1);
+        p->next_state.store(cr_preload_state::loading);
+      }
+      p->loader_cv.notify_one();
+    }
+    return;
+  }
+
+  if (state == cr_preload_state::failed) {
+    cr_plugin_load_failed(ctx);
+    p->next_state.store(cr_preload_state::idle);
+    return;
+  }
+
+  if (state != cr_preload_state::ready) {
+    return;
+  }
+
+  p->next_state.store(cr_preload_state::idle);
+  if (p->next.version != ctx.version) {
+    // a rollback happened while loading, the copy has the wrong version
+    cr_plugin_retire(ctx, p->next.handle);
+    p->next.handle = nullptr;
+    p->dirty.store(true, std::memory_order_relaxed);
+    return;
+  }
+
+  if (!cr_plugin_swap(ctx)) {
+    // the running version was already swapped out when the new one failed
+    // to validate, put it back and try the new one again after a while
+    cr_plugin_load_failed(ctx);
+    const bool swap_failed = true;
+    cr_plugin_rollback(ctx, swap_failed);
+    return;
+  }
+  p->failed_attempts = 0;
+  cr_plugin_loaded(ctx, start);
+}
+
+// internal
+// Stop the preload thread, it closes what is retired before leaving, and
+// drop a version it loaded but that was not swapped in.
+static void cr_plugin_preload_stop(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  if (p->loader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(p->loader_mutex);
+      p->loader_stop = true;
+    }
+    p->loader_cv.notify_one();
+    p->loader.join();
+  }
+  if (p->next_state.load() == cr_preload_state::ready && p->next.handle) {
+    cr_so_close((so_handle)p->next.handle);
+    p->next.handle = nullptr;
+  }
+  p->next_state.store(cr_preload_state::idle);
+  p->loader_stop = false;
+  p->preload = false;
+}
+
 static bool cr_plugin_section_validate(cr_plugin &ctx,
   cr_plugin_section_type::e type,
   intptr_t ptr, intptr_t base,
@@ -1376,7 +2445,47 @@ static bool cr_plugin_section_validate(cr_plugin &ctx,
 }
 
 // internal
-static void cr_plugin_sections_backup(cr_plugin &ctx) {
+// Copy the parts of a section in the pages written since cr_dirty_begin, from
+// and to are laid out as the section. Marks the .bss chunks copied.
+static void cr_dirty_copy(cr_dirty_pages &dirty,
+  const cr_plugin_section &sec, void *to, const void *from) {
+  for (size_t page = 0; page < dirty.pages; ++page) {
+    if (!dirty.written[page]) {
+      continue;
+    }
+    const char *at = dirty.begin + page * dirty.page_size;
+    const int64_t lo = std::max<int64_t>(at - sec.ptr, 0);
+    const int64_t hi =
+      std::min<int64_t>(at + dirty.page_size - sec.ptr, sec.size);
+    if (lo >= hi) {
+      continue;
+    }
+    std::memcpy((char *)to + lo, (const char *)from + lo, hi - lo);
+    if (!dirty.touched.empty()) {
+      for (int64_t c = lo / CR_DIRTY_CHUNK; c <= (hi - 1) / CR_DIRTY_CHUNK;
+           ++c) {
+        dirty.touched[c] = 1;
+      }
+    }
+  }
+}
+
+// internal
+// Find the .bss chunks holding anything after a whole copy.
+static void cr_dirty_touch(cr_dirty_pages &dirty,
+  const cr_plugin_section &sec) {
+  dirty.touched.assign((sec.size + CR_DIRTY_CHUNK - 1) / CR_DIRTY_CHUNK, 0);
+  for (size_t c = 0; c < dirty.touched.size(); ++c) {
+    const int64_t lo = (int64_t)c * CR_DIRTY_CHUNK;
+    const int64_t len = std::min<int64_t>(CR_DIRTY_CHUNK, sec.size - lo);
+    dirty.touched[c] = !cr_is_empty((const char *)sec.data + lo, len);
+  }
+}
+
+// internal
+// The backup copy follows the current one, only the written pages change
+// when both were the same before.
+static void cr_plugin_sections_backup(cr_plugin &ctx, bool tracked) {
   auto p = (cr_internal *)ctx.p;
   if (p->mode == CR_DISABLE) {
     return;
@@ -1385,12 +2494,16 @@ static void cr_plugin_sections_backup(cr_plugin &ctx) {
     auto cur = &p->data[i][cr_plugin_section_version::current];
     if (cur->ptr) {
       auto bkp = &p->data[i][cr_plugin_section_version::backup];
+      const bool same = tracked && bkp->data && bkp->size == cur->size;
       bkp->data = realloc(bkp->data, cur->size);
       bkp->ptr = cur->ptr;
       bkp->size = cur->size;
       bkp->base = cur->base;
 
-      if (bkp->data) {
+      if (bkp->data && same) {
+        cr_dirty_copy(p->pages[i], *cur, bkp->data, cur->data);
+      }
+      else if (bkp->data) {
         std::memcpy(bkp->data, cur->data, bkp->size);
       }
     }
@@ -1403,26 +2516,36 @@ static void cr_plugin_sections_backup(cr_plugin &ctx) {
 // valid state checkpoint. This is mostly due that a new load may want to
 // modify the state and if anything bad happens we are sure to have a valid
 // and compatible copy of the state for the previous version of the plugin.
+// With dirty page tracking only the pages written by the version are copied.
 static void cr_plugin_sections_store(cr_plugin &ctx) {
   auto p = (cr_internal *)ctx.p;
   if (p->mode == CR_DISABLE) {
     return;
   }
+  const bool tracked = cr_dirty_collect(ctx);
   auto version = cr_plugin_section_version::current;
   for (int i = 0; i < cr_plugin_section_type::count; ++i) {
-    if (p->data[i][version].ptr && p->data[i][version].data) {
-      const char *ptr = p->data[i][version].ptr;
-      const int64_t len = p->data[i][version].size;
-      std::memcpy(p->data[i][version].data, ptr, len);
+    auto &sec = p->data[i][version];
+    if (sec.ptr && sec.data) {
+      if (tracked && p->pages[i].begin) {
+        cr_dirty_copy(p->pages[i], sec, sec.data, sec.ptr);
+        continue;
+      }
+      std::memcpy(sec.data, sec.ptr, sec.size);
+      if (i == cr_plugin_section_type::bss) {
+        cr_dirty_touch(p->pages[i], sec);
+      }
     }
   }
+  p->dirty_synced = true;
 
-  cr_plugin_sections_backup(ctx);
+  cr_plugin_sections_backup(ctx, tracked);
 }
 
 // internal
 // After a load happens reload the global state from previous version from our
-// internal copy created during the unload step.
+// internal copy created during the unload step. Only the .bss chunks that
+// were ever written are copied into a new image, the rest is zero already.
 static void cr_plugin_sections_reload(cr_plugin &ctx,
   cr_plugin_section_version::e version) {
   assert(version < cr_plugin_section_version::count);
@@ -1433,12 +2556,28 @@ static void cr_plugin_sections_reload(cr_plugin &ctx,
   for (int i = 0; i < cr_plugin_section_type::count; ++i) {
     if (p->data[i][version].data) {
       const int64_t len = p->data[i][version].size;
+      const char *from = (const char *)p->data[i][version].data;
       // restore backup into the current section address as it may
       // change due aslr and backup address may be invalid
       const auto current = cr_plugin_section_version::current;
-      auto dest = (void *)p->data[i][current].ptr;
-      if (dest) {
-        std::memcpy(dest, p->data[i][version].data, len);
+      auto dest = p->data[i][current].ptr;
+      if (!dest) {
+        continue;
+      }
+      const auto &touched = p->pages[i].touched;
+      const bool sparse = version == current &&
+        i == cr_plugin_section_type::bss &&
+        touched.size() == (size_t)(len + CR_DIRTY_CHUNK - 1) / CR_DIRTY_CHUNK;
+      if (!sparse) {
+        std::memcpy(dest, from, len);
+        continue;
+      }
+      for (size_t c = 0; c < touched.size(); ++c) {
+        if (touched[c]) {
+          const int64_t lo = (int64_t)c * CR_DIRTY_CHUNK;
+          std::memcpy(dest + lo, from + lo,
+            std::min<int64_t>(CR_DIRTY_CHUNK, len - lo));
+        }
       }
     }
   }
@@ -1459,11 +2598,204 @@ static void cr_so_sections_free(cr_plugin &ctx) {
   }
 }
 
+// internal
+// Without close-write notifications, wait for the size of the file to stay
+// the same for CR_SETTLE_MS before loading it.
+static bool cr_plugin_settled(cr_internal *p) {
+  const auto size = cr_file_size(p->fullname);
+  const auto now = std::chrono::steady_clock::now();
+  if (size != p->seen_size) {
+    p->seen_size = size;
+    p->seen_at = now;
+    return false;
+  }
+  return now - p->seen_at >= std::chrono::milliseconds(CR_SETTLE_MS);
+}
+
 static bool cr_plugin_changed(cr_plugin &ctx) {
   auto p = (cr_internal *)ctx.p;
+  // a single load when nothing was reported, no syscall
+  if (p->watching && !p->dirty.load(std::memory_order_acquire)) {
+    return false;
+  }
+  if (p->failed_attempts &&
+    std::chrono::steady_clock::now() < p->retry_at) {
+    return false;
+  }
+  if (p->watching) {
+    p->dirty.store(false, std::memory_order_relaxed);
+  }
+
   const auto src = cr_last_write_time(p->fullname);
   const auto cur = p->timestamp;
-  return src > cur;
+  if (src <= cur) {
+    return false;
+  }
+  // the first version is loaded right away, a failure is retried anyway
+  return p->watching || !ctx.version || cr_plugin_settled(p);
+}
+
+// internal
+// A load failed, most likely because the file is still being written. Count
+// it and back off before the next attempt, instead of blocking the caller.
+static void cr_plugin_load_failed(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  const unsigned shift = std::min(p->failed_attempts, 16u);
+  const auto delay = std::min<long long>(
+    (long long)CR_RETRY_MIN_MS << shift, CR_RETRY_MAX_MS);
+  p->load_failures++;
+  p->failed_attempts++;
+  p->retry_at =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+  p->dirty.store(true, std::memory_order_relaxed);
+}
+
+// internal
+// Delete the copies of versions older than keep_from. A copy that can not be
+// deleted yet, a dll still loaded on windows, is tried again next time.
+static void cr_plugin_staged_trim(cr_plugin &ctx, unsigned keep_from) {
+  auto p = (cr_internal *)ctx.p;
+  while (p->staged_from < keep_from && p->staged_from < p->staged_to) {
+    const auto file = cr_version_path(p->fullname, p->staged_from);
+    if (!cr_del(file)) {
+      break;
+    }
+#if defined(_MSC_VER)
+    cr_del(cr_replace_extension(file, ".pdb"));
+#endif // defined(_MSC_VER)
+    p->staged_from++;
+  }
+}
+
+// internal
+// The copies of the running version and of the versions it can be rolled
+// back to stay, at least one version back for a rollback from disk.
+static unsigned cr_plugin_staged_keep_from(cr_plugin &ctx) {
+  const unsigned keep = std::max(CR_KEEP_VERSIONS, 1) + 1;
+  return ctx.version > keep ? ctx.version - keep : 0;
+}
+
+// internal
+// Keep the version being swapped out loaded so a rollback to it is a swap.
+// The oldest kept version is retired once there are more than
+// CR_KEEP_VERSIONS.
+static void cr_plugin_keep(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  if (CR_KEEP_VERSIONS == 0) {
+    cr_plugin_retire(ctx, p->handle);
+    return;
+  }
+
+  cr_plugin_resident kept;
+  kept.handle = p->handle;
+  kept.main = p->main;
+  kept.version = ctx.version;
+  kept.seg = p->seg;
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    kept.sections[i] = p->data[i][cr_plugin_section_version::current];
+    kept.sections[i].data = nullptr;
+  }
+  p->resident.push_back(kept);
+
+  if (p->resident.size() > CR_KEEP_VERSIONS) {
+    cr_plugin_retire(ctx, p->resident.front().handle);
+    p->resident.erase(p->resident.begin());
+  }
+}
+
+// internal
+// Roll back to the newest kept version: the crashed one is retired, and the
+// kept one gets the backup state, the state it stored itself unless this
+// is a rollback after a rollback.
+// The sections are put back as they were when the version was kept, a later
+// version may have grown them. The backup has to fit them as it would for a
+// rollback from disk, otherwise the kept version is retired and false is
+// returned.
+static bool cr_plugin_rollback_resident(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  if (p->resident.empty()) {
+    return false;
+  }
+  auto kept = p->resident.back();
+  p->resident.pop_back();
+
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    const auto type = (cr_plugin_section_type::e)i;
+    const auto &sec = kept.sections[i];
+    const auto &bkp = p->data[i][cr_plugin_section_version::backup];
+    if (!sec.ptr || !bkp.data) {
+      continue;
+    }
+    // as in cr_plugin_validate_sections, an empty .bss does not matter
+    if (type == cr_plugin_section_type::bss &&
+      cr_is_empty(bkp.data, bkp.size)) {
+      continue;
+    }
+    if (!cr_plugin_section_validate(ctx, type, (intptr_t)sec.ptr, sec.base,
+          sec.size)) {
+      cr_plugin_retire(ctx, kept.handle);
+      return false;
+    }
+  }
+
+  if (p->handle) {
+    cr_plugin_retire(ctx, p->handle);
+  }
+  p->handle = kept.handle;
+  p->main = kept.main;
+  p->seg = kept.seg;
+  for (int i = 0; i < cr_plugin_section_type::count; ++i) {
+    auto &cur = p->data[i][cr_plugin_section_version::current];
+    const auto &sec = kept.sections[i];
+    const int64_t old_size = cur.size;
+    cur.type = sec.type;
+    cur.base = sec.base;
+    cur.ptr = sec.ptr;
+    cur.size = sec.size;
+    if (sec.ptr && old_size != sec.size) {
+      cur.data = realloc(cur.data, sec.size);
+      if (cur.data && old_size < sec.size) {
+        memset((char *)cur.data + old_size, '\0', sec.size - old_size);
+      }
+      p->pages[i].touched.clear();
+    }
+  }
+  cr_plugin_sections_reload(ctx, cr_plugin_section_version::backup);
+  ctx.version = kept.version;
+  // the copy of the state no longer matches the sections, the next store
+  // copies them whole and starts tracking from there
+  p->dirty_synced = false;
+  cr_dirty_begin(ctx);
+  return true;
+}
+
+// internal
+// Retire the kept versions, used during shutdown.
+static void cr_plugin_resident_free(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  for (auto &kept : p->resident) {
+    cr_plugin_retire(ctx, kept.handle);
+  }
+  p->resident.clear();
+}
+
+// internal
+// A new version is in place: let the guest load its state and finish the
+// timing of the reload, started when cr_plugin_update was called at start.
+static int cr_plugin_loaded(cr_plugin &ctx,
+  std::chrono::steady_clock::time_point start) {
+  auto p = (cr_internal *)ctx.p;
+  const auto load_start = std::chrono::steady_clock::now();
+  int r = cr_plugin_main(ctx, CR_LOAD);
+  if (r < 0 && !ctx.failure) {
+    ctx.failure = CR_USER;
+  }
+  p->reload.load_us = cr_us_since(load_start);
+  p->reload.pause_us = cr_us_since(start);
+  p->reload.wait_us = cr_us_since(p->changed_at);
+  p->reload.version = ctx.version;
+  p->last_reload = p->reload;
+  return r;
 }
 
 // internal
@@ -1477,10 +2809,21 @@ static void cr_plugin_unload(cr_plugin &ctx, bool rollback, bool close) {
   auto p = (cr_internal *)ctx.p;
   if (p->handle) {
     if (!rollback) {
+      auto start = std::chrono::steady_clock::now();
       cr_plugin_main(ctx, close ? CR_CLOSE : CR_UNLOAD);
+      p->reload.unload_us = cr_us_since(start);
+      start = std::chrono::steady_clock::now();
       cr_plugin_sections_store(ctx);
+      p->reload.store_us = cr_us_since(start);
+    }
+    if (rollback || close) {
+      // the written pages are not wanted, only the tracking has to stop
+      cr_dirty_collect(ctx);
+      cr_plugin_retire(ctx, p->handle);
+    }
+    else {
+      cr_plugin_keep(ctx);
     }
-    cr_so_unload(ctx);
     p->handle = nullptr;
     p->main = nullptr;
   }
@@ -1490,13 +2833,26 @@ static void cr_plugin_unload(cr_plugin &ctx, bool rollback, bool close) {
 // Force a version rollback, causing a partial-unload and a load with the
 // previous version, also triggering an update with `cr_op::CR_LOAD` that
 // in turn may also cause more rollbacks.
-static bool cr_plugin_rollback(cr_plugin &ctx) {
-  if (ctx.version > 1) {
-    ctx.version -= 2;
+// After a failed swap the version to go back to is the one that was swapped
+// out, ctx.version still counts it as current: it is loaded again from its
+// own copy on disk instead of the one before it.
+static bool cr_plugin_rollback(cr_plugin &ctx, bool swap_failed) {
+  auto p = (cr_internal *)ctx.p;
+  const auto start = std::chrono::steady_clock::now();
+  p->changed_at = start;
+  p->reload = {};
+  p->reload.rollback = 1;
+  auto loaded = cr_plugin_rollback_resident(ctx);
+  if (!loaded) {
+    // version N runs the copy numbered N - 1
+    const unsigned back = swap_failed ? 1 : 2;
+    if (ctx.version >= back) {
+      ctx.version -= back;
+    }
+    loaded = cr_plugin_load_internal(ctx, true);
   }
-  auto loaded = cr_plugin_load_internal(ctx, true);
   if (loaded) {
-    loaded = cr_plugin_main(ctx, CR_LOAD) >= 0;
+    loaded = cr_plugin_loaded(ctx, start) >= 0;
     if (loaded) {
       ctx.failure = CR_NONE;
     }
@@ -1510,20 +2866,41 @@ static bool cr_plugin_rollback(cr_plugin &ctx) {
 // handling during this first update, effectivelly rollbacking if possible and
 // causing a consecutive `CR_LOAD` with the previous version.
 static void cr_plugin_reload(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  // the first version is loaded right away, there is nothing to run meanwhile
+  if (p->preload && p->handle) {
+    cr_plugin_preload_reload(ctx);
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
   if (cr_plugin_changed(ctx)) {
-    cr_plugin_load_internal(ctx, false);
-    int r = cr_plugin_main(ctx, CR_LOAD);
-    if (r < 0 && !ctx.failure) {
-      ctx.failure = CR_USER;
+    p->changed_at = start;
+    p->reload = {};
+    p->reload.detect_us = cr_us_since(start);
+    if (!cr_plugin_load_internal(ctx, false)) {
+      cr_plugin_load_failed(ctx);
+      if (p->handle) {
+        // the previous version is still loaded and keeps running
+        return;
+      }
+    }
+    else {
+      p->failed_attempts = 0;
     }
+    cr_plugin_loaded(ctx, start);
   }
 }
 
-// This is basically the plugin `main` function, should be called as
-// frequently as your core logic/application needs. -1 and -2 are the only
-// possible return values from cr meaning a fatal error (causes rollback),
-// other return values are returned directly from `cr_main`.
-extern "C" inline int cr_plugin_update(cr_plugin &ctx) {
+// Does the rollback or reload cr_plugin_update would, without stepping the
+// plugin. For hosts that call the plugin through entry points it handed over
+// on `cr_op::CR_LOAD`, see cr_plugin_call. Returns -2 if the plugin is left
+// failed, 0 otherwise.
+extern "C" inline int cr_plugin_sync(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  const int crashed = p->crashed.exchange(CR_NONE);
+  if (crashed != CR_NONE && !ctx.failure) {
+    ctx.failure = static_cast<cr_failure>(crashed);
+  }
   if (ctx.failure) {
     cr_plugin_rollback(ctx);
   }
@@ -1531,9 +2908,98 @@ extern "C" inline int cr_plugin_update(cr_plugin &ctx) {
     cr_plugin_reload(ctx);
   }
 
+  p->pending.store(ctx.failure != CR_NONE || !p->handle);
+  if (!p->watching) {
+    p->poll_at_ms.store(cr_steady_ms() + CR_POLL_MS, std::memory_order_relaxed);
+  }
+
   // -2 to differentiate from crash handling code path, meaning the crash
   // happened probably during load or unload and not update
-  if (ctx.failure) {
+  return ctx.failure ? -2 : 0;
+}
+
+// Whether cr_plugin_sync has something to do: a crash to roll back, or a
+// change to load. Can be called while other threads are in cr_plugin_call,
+// a host calling from several threads only has to stop them for
+// cr_plugin_sync when this is true. When the plugin is polled it is true
+// every CR_POLL_MS, for cr_plugin_sync to look at the file.
+extern "C" inline bool cr_plugin_sync_needed(const cr_plugin &ctx) {
+  auto p = (const cr_internal *)ctx.p;
+  if (p->pending.load(std::memory_order_acquire) ||
+    p->crashed.load(std::memory_order_acquire) != CR_NONE) {
+    return true;
+  }
+  if (p->preload) {
+    // nothing to do until the preload thread is done loading
+    const int state = p->next_state.load(std::memory_order_acquire);
+    if (state != cr_preload_state::idle) {
+      return state != cr_preload_state::loading;
+    }
+  }
+  if (!p->watching) {
+    return cr_steady_ms() >= p->poll_at_ms.load(std::memory_order_relaxed);
+  }
+  return p->dirty.load(std::memory_order_acquire);
+}
+
+// internal
+// The reader of the calling thread for the plugin, registered on first use.
+static cr_reader *cr_thread_reader(cr_internal *p) {
+  struct cached {
+    uint64_t id;
+    cr_reader *reader;
+  };
+  static thread_local std::vector<cached> readers;
+  for (const auto &c : readers) {
+    if (c.id == p->id) {
+      return c.reader;
+    }
+  }
+  auto reader = new cr_reader;
+  {
+    std::lock_guard<std::mutex> lock(p->readers_mutex);
+    p->readers.emplace_back(reader);
+  }
+  readers.push_back({p->id, reader});
+  return reader;
+}
+
+// Read-side section for threads calling into the plugin while another thread
+// may reload it. Take the entry points the plugin handed over after entering
+// and stop using them before leaving. A version that is replaced is only
+// closed once every thread that entered before the swap has left, the
+// reload itself does not wait for them. Sections do not nest, and a thread
+// must leave before it calls cr_plugin_sync or cr_plugin_update.
+extern "C" inline void cr_plugin_enter(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  auto reader = cr_thread_reader(p);
+  reader->epoch.store(p->epoch.load(std::memory_order_relaxed));
+  // the entry points are read after the epoch is visible to the reloader
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+extern "C" inline void cr_plugin_leave(cr_plugin &ctx) {
+  auto p = (cr_internal *)ctx.p;
+  cr_thread_reader(p)->epoch.store(0, std::memory_order_release);
+}
+
+// Call into the plugin with the crash protection `cr_main` gets, for entry
+// points the plugin handed over itself. Several threads may be in
+// cr_plugin_call at once, and keep calling while another thread reloads
+// when they are in a cr_plugin_enter section. A crash is rolled back by the
+// next cr_plugin_sync or cr_plugin_update. Returns -1 on a crash, 0
+// otherwise.
+template <typename Function>
+inline int cr_plugin_call(cr_plugin &ctx, Function &&fn) {
+  return cr_guard(ctx, fn);
+}
+
+// This is basically the plugin `main` function, should be called as
+// frequently as your core logic/application needs. -1 and -2 are the only
+// possible return values from cr meaning a fatal error (causes rollback),
+// other return values are returned directly from `cr_main`.
+extern "C" inline int cr_plugin_update(cr_plugin &ctx) {
+  if (cr_plugin_sync(ctx) < 0) {
     return -2;
   }
 
@@ -1554,16 +3020,55 @@ extern "C" inline bool cr_plugin_load(cr_plugin &ctx, const char *fullpath) {
   ctx.version = 0;
   ctx.failure = CR_NONE;
   cr_plat_init();
+  cr_watch_start(ctx);
   return true;
 }
 
+// Load new versions on a background thread: the copy, load, relocation and
+// validation are done while the current version keeps running, and
+// cr_plugin_update then only swaps the new version in and transfers the
+// state. Call after cr_plugin_load.
+extern "C" inline void cr_plugin_preload(cr_plugin &ctx, bool enable) {
+  auto p = (cr_internal *)ctx.p;
+  assert(p);
+  if (!enable) {
+    cr_plugin_preload_stop(ctx);
+    return;
+  }
+  if (!p->preload) {
+    p->preload = true;
+    p->loader = std::thread(cr_plugin_loader, &ctx);
+  }
+}
+
+// Number of times loading a new version has failed, most often because it
+// was still being written. Failed loads are retried with a backoff.
+extern "C" inline unsigned cr_plugin_load_failures(const cr_plugin &ctx) {
+  auto p = (const cr_internal *)ctx.p;
+  assert(p);
+  return p->load_failures;
+}
+
+// Timing of the last reload or rollback, version is 0 if there was none.
+extern "C" inline cr_reload_stats cr_plugin_reload_stats(
+  const cr_plugin &ctx) {
+  auto p = (const cr_internal *)ctx.p;
+  assert(p);
+  return p->last_reload;
+}
+
 // Call to cleanup internal state once the plugin is not required anymore.
 extern "C" inline void cr_plugin_close(cr_plugin &ctx) {
   const bool rollback = false;
   const bool close = true;
+  cr_plugin_preload_stop(ctx);
   cr_plugin_unload(ctx, rollback, close);
+  cr_dirty_end(ctx);
+  cr_plugin_resident_free(ctx);
   cr_so_sections_free(ctx);
+  cr_watch_stop(ctx);
   auto p = (cr_internal *)ctx.p;
+  cr_plugin_staged_trim(ctx, p->staged_to);
   delete p;
   ctx.p = nullptr;
   ctx.version = 0;
@@ -10,10 +10,20 @@
 // Data types
 // ============================================================ //
 
+struct Plugin_api {
+  static constexpr uint32_t ABI_VERSION = 1;
+  uint32_t abi_version = 0;
+  int (*add)(int a, int b) = nullptr;
+  void (*add_batch)(const int* a, const int* b, int* result, uint64_t count) = nullptr;
+};
+
 struct Host_data {
-  int a = 0;;
-  int b = 0;;
-  int result = 0;
+  static constexpr int MAX_BATCH = 256;
+  int count = 0;
+  int a[MAX_BATCH] = {};
+  int b[MAX_BATCH] = {};
+  int result[MAX_BATCH] = {};
+  const Plugin_api* api = nullptr;
 };
 
 static Host_data* m_data;
@@ -28,6 +38,15 @@ int qadd(const int a, const int b) {
   return 1337;
 }
 
+void qadd_batch(const int* a, const int* b, int* result, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) {
+    result[i] = qadd(a[i], b[i]);
+  }
+}
+
+// handed to the host on load, it then calls these directly
+static const Plugin_api m_api = { Plugin_api::ABI_VERSION, qadd, qadd_batch };
+
 // ============================================================ //
 // Main
 // ============================================================ //
@@ -41,16 +60,18 @@ CR_EXPORT int cr_main(struct cr_plugin* ctx, enum cr_op operation) {
   switch (operation) {
   case CR_LOAD:
     //init();
+    m_data->api = &m_api;
     return 0;
   case CR_UNLOAD:
     // if needed, save stuff to pass over to next instance
+    m_data->api = nullptr;
     return 0;
   case CR_CLOSE:
     //shutdown();
+    m_data->api = nullptr;
     return 0;
   case CR_STEP:
-    static_cast<Host_data*>(ctx->userdata)->result = 
-      qadd(static_cast<Host_data*>(ctx->userdata)->a, static_cast<Host_data*>(ctx->userdata)->b);
+    qadd_batch(m_data->a, m_data->b, m_data->result, m_data->count);
     return 0;
   }
 
@@ -1003,7 +1003,7 @@ static void cr_copy(const std::string &from, const std::string &to) {
 // a helper function to validate that an area of memory is empty
 // this is used to validate that the data in the .bss haven't changed
 // and that we are safe to discard it and uses the new one.
-bool cr_is_empty(const void *const buf, int64_t len) {
+static bool cr_is_empty(const void *const buf, int64_t len) {
   if (!buf || !len) {
     return true;
   }
@@ -1228,8 +1228,8 @@ static cr_plugin_main_func cr_so_symbol(so_handle handle) {
   return new_main;
 }
 
-volatile std::sig_atomic_t cr_signal = 0;
-sigjmp_buf env;
+static volatile std::sig_atomic_t cr_signal = 0;
+static sigjmp_buf env;
 
 static void cr_signal_handler(int sig, siginfo_t *si, void *uap) {
   (void)uap;